@@ -32,6 +32,7 @@
  */
  
 #include <vector> 
+#include <boost/scoped_ptr.hpp>
 #include <math.h> // wegen Optimization.h
 #include <log4cpp/Category.hh>
 
@@ -48,13 +49,121 @@ static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Abso
 #include <utDataflow/ComponentFactory.h>
 #include <utMeasurement/Measurement.h>
 #include <utCalibration/AbsoluteOrientation.h>
+#include <utUtil/Exception.h>
 
+#include "ParallelRansac.h"
 
 namespace Ubitrack { namespace Components {
 
 using namespace Ubitrack::Math;
 
 
+/**
+ * absolute orientation problem for ParallelRansac.
+ *
+ * The correspondences are additionally stored as a structure of arrays, so the errors of a block of
+ * correspondences are computed by simple loops over contiguous coordinates that the compiler vectorizes.
+ * Like \c Calibration::EvaluateAbsoluteOrientation, the error of a correspondence is the distance between
+ * b and the transformed a, | R * a + t - b |, as the result is the pose from B to A. Single errors are computed by the same loop, so the T(d,d)
+ * test and the scoring cannot disagree.
+ */
+class AbsoluteOrientationProblem
+{
+public:
+	typedef Math::Pose result_type;
+
+	AbsoluteOrientationProblem( const std::vector< Math::Vector< double, 3 > >& a, const std::vector< Math::Vector< double, 3 > >& b )
+		: m_a( a )
+		, m_b( b )
+	{
+		for ( std::size_t c = 0; c < 3; c++ )
+		{
+			m_ax[ c ].resize( a.size() );
+			m_bx[ c ].resize( b.size() );
+			for ( std::size_t i = 0; i < a.size(); i++ )
+			{
+				m_ax[ c ][ i ] = a[ i ]( c );
+				m_bx[ c ][ i ] = b[ i ]( c );
+			}
+		}
+	}
+
+	std::size_t size() const
+	{ return m_a.size(); }
+
+	bool estimate( Math::Pose& result, const std::vector< std::size_t >& indices ) const
+	{
+		std::vector< Math::Vector< double, 3 > > a;
+		std::vector< Math::Vector< double, 3 > > b;
+		a.reserve( indices.size() );
+		b.reserve( indices.size() );
+		for ( std::size_t i = 0; i < indices.size(); i++ )
+		{
+			a.push_back( m_a[ indices[ i ] ] );
+			b.push_back( m_b[ indices[ i ] ] );
+		}
+
+		try
+		{
+			result = Calibration::calculateAbsoluteOrientation( a, b );
+		}
+		catch ( const Util::Exception& )
+		{
+			// degenerate sample
+			return false;
+		}
+		return true;
+	}
+
+	double error( const Math::Pose& result, std::size_t i ) const
+	{
+		double e;
+		errors( result, i, i + 1, &e );
+		return e;
+	}
+
+	void errors( const Math::Pose& result, std::size_t begin, std::size_t end, double* out ) const
+	{
+		// rotation matrix and translation
+		double r[ 3 ][ 3 ];
+		for ( std::size_t j = 0; j < 3; j++ )
+		{
+			Math::Vector< double, 3 > axis( 0.0, 0.0, 0.0 );
+			axis( j ) = 1.0;
+			Math::Vector< double, 3 > column( result.rotation() * axis );
+			for ( std::size_t i = 0; i < 3; i++ )
+				r[ i ][ j ] = column( i );
+		}
+		const double tx( result.translation()( 0 ) );
+		const double ty( result.translation()( 1 ) );
+		const double tz( result.translation()( 2 ) );
+
+		const double* ax( &m_ax[ 0 ][ begin ] );
+		const double* ay( &m_ax[ 1 ][ begin ] );
+		const double* az( &m_ax[ 2 ][ begin ] );
+		const double* bx( &m_bx[ 0 ][ begin ] );
+		const double* by( &m_bx[ 1 ][ begin ] );
+		const double* bz( &m_bx[ 2 ][ begin ] );
+		const std::size_t n( end - begin );
+		for ( std::size_t i = 0; i < n; i++ )
+		{
+			double dx( r[ 0 ][ 0 ] * ax[ i ] + r[ 0 ][ 1 ] * ay[ i ] + r[ 0 ][ 2 ] * az[ i ] + tx - bx[ i ] );
+			double dy( r[ 1 ][ 0 ] * ax[ i ] + r[ 1 ][ 1 ] * ay[ i ] + r[ 1 ][ 2 ] * az[ i ] + ty - by[ i ] );
+			double dz( r[ 2 ][ 0 ] * ax[ i ] + r[ 2 ][ 1 ] * ay[ i ] + r[ 2 ][ 2 ] * az[ i ] + tz - bz[ i ] );
+			out[ i ] = std::sqrt( dx * dx + dy * dy + dz * dz );
+		}
+	}
+
+protected:
+	const std::vector< Math::Vector< double, 3 > >& m_a;
+	const std::vector< Math::Vector< double, 3 > >& m_b;
+
+	/** coordinates of the points of a and b */
+	std::vector< double > m_ax[ 3 ];
+	std::vector< double > m_bx[ 3 ];
+};
+
+
 /**
  * @ingroup dataflow_components
  * Absolute orientation component.
@@ -69,11 +178,20 @@ using namespace Ubitrack::Math;
  *
  * @par Configuration
  * DataflowConfiguration: expansion="space" or "time" for time/space expansion
+ * - "threshold", "setSize", "minInliers", "minRuns", "maxRuns": RANSAC parameters
+ * - "threads": number of threads evaluating hypotheses, 0 for one per core (default 1). The threads are started
+ *   with the component and reused for every computation.
+ * - "confidence": stop as soon as an all-inlier sample was drawn with this probability, 0 (default) disables
+ * - "sampling": "uniform" (default) or "prosac" if the correspondences are sorted by decreasing quality
+ * - "preTest": number of random correspondences that must be inliers before a hypothesis is scored (default 0)
  *
  * @par Operation
  * The component computes the transformation from a coordinate system A to a coordinate system B,
  * given corresponding points in A (InputA) and B (InputB). For details see
  * \c Ubitrack::Calibration::calculateAbsoluteOrientation.
+ *
+ * With the default "threads", "confidence", "sampling" and "preTest", the plain single-threaded RANSAC is used.
+ * Otherwise the hypotheses are evaluated by a ParallelRansac.
  */
  
  
@@ -97,12 +215,27 @@ public:
 		, m_nMinInliers( 3 )
 		, m_nMinRuns( 1 )
 		, m_nMaxRuns( 100 )
+		, m_bParallel( false )
     {
 		subgraph->m_DataflowAttributes.getAttributeData( "threshold", m_threshold );
 		subgraph->m_DataflowAttributes.getAttributeData( "setSize", m_nSetSize );
 		subgraph->m_DataflowAttributes.getAttributeData( "minInliers", m_nMinInliers );
 		subgraph->m_DataflowAttributes.getAttributeData( "minRuns", m_nMinRuns );
 		subgraph->m_DataflowAttributes.getAttributeData( "maxRuns", m_nMaxRuns );
+
+		m_params.threshold = m_threshold;
+		m_params.setSize = m_nSetSize;
+		m_params.minInliers = m_nMinInliers;
+		m_params.minRuns = m_nMinRuns;
+		m_params.maxRuns = m_nMaxRuns;
+		subgraph->m_DataflowAttributes.getAttributeData( "threads", m_params.threads );
+		subgraph->m_DataflowAttributes.getAttributeData( "confidence", m_params.confidence );
+		m_params.bProsac = subgraph->m_DataflowAttributes.getAttributeString( "sampling" ) == "prosac";
+		subgraph->m_DataflowAttributes.getAttributeData( "preTest", m_params.preTest );
+
+		m_bParallel = m_params.threads != 1 || m_params.confidence > 0.0 || m_params.bProsac || m_params.preTest > 0;
+		if ( m_bParallel )
+			m_pPool.reset( new RansacThreadPool( m_params.threads ) );
     }
 
 	/** Method that computes the result. */
@@ -112,6 +245,23 @@ public:
 			UBITRACK_THROW( "Illegal number of correspondences" );
 
 		boost::shared_ptr< Math::Pose > p( new Math::Pose() );
+		if ( m_bParallel )
+		{
+			AbsoluteOrientationProblem problem( *m_inPortA.get(), *m_inPortB.get() );
+			ParallelRansac< AbsoluteOrientationProblem > ransac( problem, m_params, *m_pPool );
+			std::vector< std::size_t > inliers;
+			unsigned number = ransac.run( *p, inliers );
+
+			LOG4CPP_INFO( logger, "Parallel robust absolute orientation evaluated " << number << " hypotheses, "
+				<< inliers.size() << " of " << problem.size() << " correspondences are inliers" );
+
+			if ( inliers.empty() )
+				UBITRACK_THROW( "No hypothesis with enough inliers found" );
+
+			m_outPort.send( Measurement::Pose( t, p ) );
+			return;
+		}
+
 		unsigned number = 
 			Ransac( *p
 			, *m_inPortA.get(), *m_inPortB.get()
@@ -150,6 +300,15 @@ protected:
 	
 	/** Output port of the component. */
 	unsigned m_nMaxRuns;
+
+	/** use the ParallelRansac? */
+	bool m_bParallel;
+
+	/** parameters of the ParallelRansac */
+	RansacParameters m_params;
+
+	/** threads of the ParallelRansac, started once */
+	boost::scoped_ptr< RansacThreadPool > m_pPool;
 };
 
 
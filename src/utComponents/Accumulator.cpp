@@ -31,12 +31,15 @@
  * Any number of input edges can be used, as long as they all supply the correct
  * measurement type. A dataflow attribute named maxLength specifies the maximum
  * number of list elements. If this amount is reached, the accumulator behaves
- * as a FIFO.
+ * as a FIFO. The elements are kept in a ring buffer, so no elements are shifted.
+ * A dataflow attribute named sendEvery specifies that only every n-th received
+ * measurement triggers an output list.
  * 
  * @author Florian Echtler <echtler@in.tum.de>
  */
 
 #include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
 //#include <log4cpp/Category.hh>
 
 #include <utDataflow/PullConsumer.h>
@@ -46,6 +49,8 @@
 #include <utDataflow/ComponentFactory.h>
 #include <utMeasurement/Measurement.h>
 
+#include "ListPool.h"
+
 // currently unused
 // static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Components.Accumulator" ) );
 
@@ -65,11 +70,19 @@ public:
 	Accumulator( const std::string& nm, boost::shared_ptr< Graph::UTQLSubgraph > pCfg )
 		: Ubitrack::Dataflow::Component( nm )
 		, m_maxLength( 100 )
-		, m_size( 0 )
+		, m_sendEvery( 1 )
+		, m_head( 0 )
+		, m_counter( 0 )
 		, m_data()
 		, m_outPort( "Output", *this )
 	{
 		pCfg->m_DataflowAttributes.getAttributeData( "maxLength", m_maxLength );
+		pCfg->m_DataflowAttributes.getAttributeData( "sendEvery", m_sendEvery );
+		if ( m_maxLength == 0 )
+			m_maxLength = 1;
+		if ( m_sendEvery == 0 )
+			m_sendEvery = 1;
+		m_data.reserve( m_maxLength );
 
 		for ( Graph::UTQLSubgraph::EdgeMap::iterator it = pCfg->m_Edges.begin(); it != pCfg->m_Edges.end(); it++ )
 			if ( it->second->isInput() )
@@ -84,23 +97,49 @@ public:
 
 protected:
 
+	typedef std::vector< typename EventType::value_type > ListType;
+
 	/** called when a new item arrives */
 	void receive( const EventType& event )
 	{
-		m_data.push_back( *event );
-		if (++m_size > m_maxLength) {
-			m_data.erase( m_data.begin() );
-			m_size--;
+		// fill the ring, then overwrite the oldest element
+		if ( m_data.size() < m_maxLength )
+			m_data.push_back( *event );
+		else
+		{
+			m_data[ m_head ] = *event;
+			m_head = ( m_head + 1 ) % m_maxLength;
 		}
-		m_outPort.send( Measurement::Measurement< typename std::vector< typename EventType::value_type > >( event.time(), m_data ) );
+
+		if ( ++m_counter < m_sendEvery )
+			return;
+		m_counter = 0;
+
+		// oldest element first, in a recycled list
+		boost::shared_ptr< ListType > pOutput( m_pool.acquire() );
+		pOutput->reserve( m_maxLength );
+		pOutput->assign( m_data.begin() + m_head, m_data.end() );
+		pOutput->insert( pOutput->end(), m_data.begin(), m_data.begin() + m_head );
+		m_outPort.send( Measurement::Measurement< ListType >( event.time(), pOutput ) );
 	}
 
 	/** Properties of the accumulator*/
-	unsigned int m_maxLength,m_size;
-	std::vector< typename EventType::value_type > m_data;
+	unsigned int m_maxLength, m_sendEvery;
+
+	/** index of the oldest element once the ring is full */
+	unsigned int m_head;
+
+	/** events received since the last output */
+	unsigned int m_counter;
+
+	/** ring buffer of the last maxLength elements */
+	ListType m_data;
+
+	/** recycled output lists */
+	ListPool< ListType > m_pool;
 
 	/** Ports of the component */
-	PushSupplier< Measurement::Measurement< typename std::vector< typename EventType::value_type > > > m_outPort;
+	PushSupplier< Measurement::Measurement< ListType > > m_outPort;
 	std::vector< boost::shared_ptr< Dataflow::PushConsumer< EventType > > > m_inPorts;
 
 };
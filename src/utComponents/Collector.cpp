@@ -46,6 +46,8 @@
 #include <utGraph/UTQLSubgraph.h>
 #include <utUtil/Exception.h>
 
+#include "ListPool.h"
+
 // LOG4CPP
 #include <log4cpp/Category.hh>
 static log4cpp::Category& eventLogger( log4cpp::Category::getInstance( "Ubitrack.Events.Components.Collector" ) );
@@ -80,14 +82,15 @@ public:
 
 	EventTypeB sendOutput( Measurement::Timestamp t )
 	{
-		EventTypeB List;
+		// the pulled list may be shared with its supplier, so the result is built in a recycled list
+		boost::shared_ptr< typename EventTypeB::value_type > pList( m_pool.acquire() );
 		try
 		{
-			List = m_inPortB.get( t );
+			EventTypeB List = m_inPortB.get( t );
+			pList->assign( List->begin(), List->end() );
 		}
 		catch ( const Util::Exception& e )
 		{
-		        List = EventTypeB( typename EventTypeB::value_type() );
         		LOG4CPP_WARN( eventLogger, "Got exception: " << e );
 		}
 		catch ( const std::exception& e )
@@ -98,7 +101,7 @@ public:
 		try
 		{
 			EventTypeA Meas = m_inPortA.get( t );
-			List->push_back( *Meas );
+			pList->push_back( *Meas );
 		}
 		catch ( const Util::Exception& e )
 		{
@@ -108,7 +111,7 @@ public:
 		{
 			LOG4CPP_WARN( eventLogger, "Got unknown exception: " << e.what() );
 		}
-		return EventTypeB( t, List );
+		return EventTypeB( t, pList );
 	}
 
 protected:
@@ -121,6 +124,9 @@ protected:
 
 	/** Output port of the component. */	
 	Dataflow::PullSupplier< EventTypeB > m_outPort;
+
+	/** recycled output lists */
+	ListPool< typename EventTypeB::value_type > m_pool;
 };
 
 
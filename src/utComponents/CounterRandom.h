@@ -0,0 +1,160 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#ifndef __UBITRACK_COMPONENTS_COUNTERRANDOM_H_INCLUDED__
+#define __UBITRACK_COMPONENTS_COUNTERRANDOM_H_INCLUDED__
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Counter-based random number generator
+ */
+
+#include <string>
+#include <boost/cstdint.hpp>
+#include <boost/config.hpp>
+
+namespace Ubitrack { namespace Components {
+
+/**
+ * @ingroup dataflow_components
+ * Philox4x32-10 counter-based random number generator (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3").
+ *
+ * Each block of four outputs is a keyed bijection of a 128 bit counter, consisting of the block index and a
+ * stream id. The seed is the key. Generators with the same seed and different stream ids therefore produce
+ * independent sequences without any coordination, and any position of a sequence can be reached in
+ * constant time with discard().
+ *
+ * Models the boost UniformRandomNumberGenerator concept, so it can be used with boost::variate_generator.
+ */
+class CounterRandom
+{
+public:
+	typedef boost::uint32_t result_type;
+	BOOST_STATIC_CONSTANT( bool, has_fixed_range = false );
+
+	CounterRandom( boost::uint64_t seed = 0, boost::uint64_t stream = 0 )
+	{
+		this->seed( seed, stream );
+	}
+
+	/** restarts the sequence of the given seed and stream */
+	void seed( boost::uint64_t seed, boost::uint64_t stream = 0 )
+	{
+		m_key[ 0 ] = boost::uint32_t( seed );
+		m_key[ 1 ] = boost::uint32_t( seed >> 32 );
+		m_stream = stream;
+		m_block = 0;
+		m_used = 4;
+	}
+
+	result_type min BOOST_PREVENT_MACRO_SUBSTITUTION () const
+	{ return 0; }
+
+	result_type max BOOST_PREVENT_MACRO_SUBSTITUTION () const
+	{ return 0xFFFFFFFFu; }
+
+	/** returns the next 32 random bits */
+	result_type operator()()
+	{
+		if ( m_used == 4 )
+		{
+			generate( m_block++, m_buffer );
+			m_used = 0;
+		}
+		return m_buffer[ m_used++ ];
+	}
+
+	/** returns a uniform random number in [0, 1) with 53 bits of precision */
+	double uniform01()
+	{
+		boost::uint64_t hi = ( *this )() >> 5;
+		boost::uint64_t lo = ( *this )() >> 6;
+		return ( hi * 67108864.0 + lo ) * ( 1.0 / 9007199254740992.0 );
+	}
+
+	/** skips n outputs in constant time */
+	void discard( boost::uint64_t n )
+	{
+		boost::uint64_t position = ( m_block - ( m_used < 4 ? 1 : 0 ) ) * 4 + ( m_used < 4 ? m_used : 0 ) + n;
+		m_block = position / 4;
+		m_used = 4;
+		if ( position % 4 )
+		{
+			generate( m_block++, m_buffer );
+			m_used = std::size_t( position % 4 );
+		}
+	}
+
+	/** derives a stream id from a name, e.g. to give each component its own default stream */
+	static boost::uint64_t streamFromName( const std::string& name )
+	{
+		// FNV-1a
+		boost::uint64_t h = 14695981039346656037ULL;
+		for ( std::size_t i = 0; i < name.size(); i++ )
+		{
+			h ^= boost::uint8_t( name[ i ] );
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+protected:
+	/** computes the four outputs of a block */
+	void generate( boost::uint64_t block, result_type* out ) const
+	{
+		boost::uint32_t c[ 4 ] = { boost::uint32_t( block ), boost::uint32_t( block >> 32 ),
+			boost::uint32_t( m_stream ), boost::uint32_t( m_stream >> 32 ) };
+		boost::uint32_t k[ 2 ] = { m_key[ 0 ], m_key[ 1 ] };
+
+		for ( int round = 0; round < 10; round++ )
+		{
+			boost::uint64_t p0 = boost::uint64_t( 0xD2511F53u ) * c[ 0 ];
+			boost::uint64_t p1 = boost::uint64_t( 0xCD9E8D57u ) * c[ 2 ];
+			boost::uint32_t n[ 4 ] = {
+				boost::uint32_t( p1 >> 32 ) ^ c[ 1 ] ^ k[ 0 ], boost::uint32_t( p1 ),
+				boost::uint32_t( p0 >> 32 ) ^ c[ 3 ] ^ k[ 1 ], boost::uint32_t( p0 ) };
+			for ( int i = 0; i < 4; i++ )
+				c[ i ] = n[ i ];
+			k[ 0 ] += 0x9E3779B9u;
+			k[ 1 ] += 0xBB67AE85u;
+		}
+
+		for ( int i = 0; i < 4; i++ )
+			out[ i ] = c[ i ];
+	}
+
+	boost::uint32_t m_key[ 2 ];
+	boost::uint64_t m_stream;
+
+	/** index of the next block to generate */
+	boost::uint64_t m_block;
+
+	/** outputs of the current block and number of them already returned */
+	result_type m_buffer[ 4 ];
+	std::size_t m_used;
+};
+
+} } // namespace Ubitrack::Components
+
+#endif
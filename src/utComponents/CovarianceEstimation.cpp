@@ -31,6 +31,7 @@
  */
 
 #include <string>
+#include <vector>
 
 #include <boost/scoped_ptr.hpp>
 #include <boost/bind.hpp>
@@ -41,12 +42,16 @@
 
 #include <utDataflow/Component.h>
 #include <utDataflow/PullConsumer.h>
+#include <utDataflow/PushConsumer.h>
 #include <utDataflow/PushSupplier.h>
 #include <utDataflow/ComponentFactory.h>
 #include <utMeasurement/Measurement.h>
 #include <utUtil/Exception.h>
 #include <utUtil/OS.h>
 
+#include "RunningStatistics.h"
+#include "FixedQuaternion.h"
+
 
 using namespace Ubitrack;
 namespace ublas = boost::numeric::ublas;
@@ -57,6 +62,164 @@ static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Comp
 
 namespace Ubitrack { namespace Components {
 
+/**
+ * Converts mean and covariance of poses as additive 7-vectors into an ErrorPose.
+ * The order is tx, ty, tz, qx, qy, qz, qw.
+ */
+inline Math::ErrorPose errorPoseFromMoments( const Math::Vector< double, 7 >& mean, const Math::Matrix< double, 7, 7 >& covariance )
+{
+	/*
+	 * Use inverted mean value to transform the additive 7x7
+	 * covariance to the 6x6 multiplicative format The conversion is
+	 * conducted according to the following formulas:
+	 * 
+	 * q_m = q_0 * ( q_id + q_e )
+	 * 
+	 * where q_id is the identity quaternion and q_e is a quaternion
+	 * with expectation ((0,0,0),0) and a covariance covering only the
+	 * imaginary part. Together ( q_id + q_e ) represent a small
+	 * quaternion ((e_rx, e_ry, e_rz), 1). If mean and covariance of
+	 * the quaternion are estimated according to the usual formulas,
+	 * however, one gets the following instead:
+	 * 
+	 * q_m = q_0 + q'_e
+	 * 
+	 * Together with the first formula, this yields
+	 * 
+	 * q_0 * ( q_id + q_e ) = q_0 + q'_e
+	 * ( q_id + q_e )       = ~q_0 * q_0 + ~q_0 * q'_e
+	 * q_e                  = q_id + ~q_0 * q'_e - q_id
+	 * q_e                  = ~q_0 * q'_e
+	 *
+	 * Thus, one has to rotate the distribution by ~q_0. The variance
+	 * of the real part can then be discarded, it should be ~0.
+	 */
+
+	Math::Vector< double, 7 > invMean;
+	(~(Math::Pose::fromVector( mean ) ) ).toVector( invMean );
+	Math::ErrorVector< double, 7 > ev ( invMean, covariance );
+	Math::ErrorPose invEp = Math::ErrorPose::fromAdditiveErrorVector( ev );
+	
+	// We created the error pose from the inverted mean value above, to obtain the transformed 6x6 covariance
+	// Now, we recreate the error pose with the computed mean value.
+	Math::ErrorPose ep( Math::Pose::fromVector( mean ), invEp.covariance() );
+
+	LOG4CPP_TRACE( logger, "Running (empirical) mean / covariance: " << std::endl << ep );
+
+	// For debug purposes, compute positional and angular error...
+	Math::Matrix< double, 6, 6 > covar = ep.covariance();
+	double posRms = sqrt ( covar (0,0) + covar (1,1) + covar (2,2) );
+	LOG4CPP_INFO( logger, "RMS positional error [mm]: " << posRms );
+	Math::Vector< double, 3 > axis;
+	axis (0) = sqrt ( covar (3,3) );
+	axis (1) = sqrt ( covar (4,4) );
+	axis (2) = sqrt ( covar (5,5) );
+	double norm = norm_2 (axis);
+	double phi = asin ( norm ) * 2;
+	phi = phi * 180 / boost::math::constants::pi<double>();
+	LOG4CPP_INFO( logger, "Standard deviation of rotational error [deg]: " << phi );
+	
+	return ep;
+}
+
+
+/** number of components of the samples of a value type */
+template< class ValueType >
+struct SampleSize;
+
+template<>
+struct SampleSize< Math::Vector< double, 3 > >
+{ static const std::size_t value = 3; };
+
+template<>
+struct SampleSize< Math::Pose >
+{ static const std::size_t value = 7; };
+
+
+/** converts a position to a sample */
+inline void toSample( const Math::Vector< double, 3 >& pos, double* x, const double* )
+{
+	for ( std::size_t i = 0; i < 3; i++ )
+		x[ i ] = pos( i );
+}
+
+
+/**
+ * converts a pose to a sample in the order tx, ty, tz, qx, qy, qz, qw.
+ * The quaternion is flipped into the hemisphere of the reference quaternion, if one is given.
+ */
+inline void toSample( const Math::Pose& pose, double* x, const double* reference )
+{
+	Math::Vector< double, 7 > v;
+	pose.toVector( v );
+
+	double dot( 0.0 );
+	if ( reference )
+		for ( std::size_t i = 0; i < 4; i++ )
+			dot += v( 3 + i ) * reference[ i ];
+	for ( std::size_t i = 0; i < 7; i++ )
+		x[ i ] = ( i >= 3 && dot < 0 ) ? -v( i ) : v( i );
+}
+
+
+/** mean and covariance of positions */
+inline Math::ErrorVector< double, 3 > estimateFromStatistics( const RunningStatistics< 3 >& stats, Math::ErrorVector< double, 3 >* )
+{
+	Math::Vector< double, 3 > mean;
+	Math::Matrix< double, 3, 3 > covariance;
+	for ( std::size_t i = 0; i < 3; i++ )
+	{
+		mean( i ) = stats.mean()[ i ];
+		for ( std::size_t j = 0; j < 3; j++ )
+			covariance( i, j ) = stats.covariance( i, j );
+	}
+
+	Math::ErrorVector< double, 3 > ev( mean, covariance );
+	LOG4CPP_TRACE( logger, "Empirical mean / covariance: " << std::endl << ev );
+	return ev;
+}
+
+
+/**
+ * mean and covariance of poses.
+ * The mean rotation is the eigenvector of the largest eigenvalue of the quaternion scatter matrix E[ q q^T ]
+ * (Markley et al., "Averaging Quaternions"), which is the rotation that minimizes the mean squared chordal
+ * distance to the samples. The covariance of the quaternions is taken around this mean.
+ */
+inline Math::ErrorPose estimateFromStatistics( const RunningStatistics< 7 >& stats, Math::ErrorPose* )
+{
+	Math::Vector< double, 7 > mean;
+	Math::Matrix< double, 7, 7 > covariance;
+	for ( std::size_t i = 0; i < 7; i++ )
+	{
+		mean( i ) = stats.mean()[ i ];
+		for ( std::size_t j = 0; j < 7; j++ )
+			covariance( i, j ) = stats.covariance( i, j );
+	}
+
+	double quaternionMean[ 4 ];
+	double quaternionCov[ 4 ][ 4 ];
+	for ( std::size_t i = 0; i < 4; i++ )
+	{
+		quaternionMean[ i ] = mean( 3 + i );
+		for ( std::size_t j = 0; j < 4; j++ )
+			quaternionCov[ i ][ j ] = covariance( 3 + i, 3 + j );
+	}
+	double q[ 4 ];
+	quaternionScatterMean( quaternionMean, quaternionCov, q );
+
+	// the position block is unchanged
+	for ( std::size_t i = 0; i < 4; i++ )
+	{
+		for ( std::size_t j = 0; j < 4; j++ )
+			covariance( 3 + i, 3 + j ) = quaternionCov[ i ][ j ];
+		mean( 3 + i ) = q[ i ];
+	}
+
+	return errorPoseFromMoments( mean, covariance );
+}
+
+
 /**
  * @ingroup dataflow_components
  * Covariance estimation component
@@ -65,6 +228,9 @@ namespace Ubitrack { namespace Components {
  * PushConsumer< EventType > with name "PerturbedInput".
  * PushConsumer< Button > with name "TriggerInput".
  *
+ * Note: Additional inputs for several perturbed subgraphs can be
+ * generated using arbitrary edge names starting with "PerturbedInput".
+ *
  * @par Output Ports
  * PushSupplier< EventType > with name "Distribution".
  * PushSupplier< Button > with name "Sync".
@@ -80,6 +246,13 @@ namespace Ubitrack { namespace Components {
  * PerturbedInput} input. Finally, one result is pushed onward on the
  * {@code Distribution} output.
  *
+ * Mean and covariance are accumulated with Welford's algorithm, which
+ * stays accurate for samples far from the origin. Each input has its own
+ * accumulator, the accumulators are merged when the result is computed.
+ * Quaternions are flipped into the hemisphere of the first sample, and the
+ * mean rotation is computed from their accumulated second moments, see
+ * estimateFromStatistics.
+ *
  * @par Instances
  *
  */
@@ -88,6 +261,8 @@ class CovarianceEstimation
 	: public Dataflow::Component
 {
 public:
+	static const std::size_t N = SampleSize< typename EventType::value_type >::value;
+
 	/**
 	 * UTQL component constructor.
 	 *
@@ -96,11 +271,11 @@ public:
 	 */
 	CovarianceEstimation( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
 		: Dataflow::Component( sName )
-		, m_inPortPerturbed( "PerturbedInput", *this, boost::bind( &CovarianceEstimation::dataIn, this, _1 ) )
 		, m_inPortTrigger( "TriggerInput", *this, boost::bind( &CovarianceEstimation::triggerIn, this, _1 ) )
 		, m_outPortSync( "Sync", *this )
 		, m_outPortDist ( "Distribution", *this )
 		, m_bStopped( true )
+		, m_bReference( false )
 		, m_counter ( 0 )
 		, m_size( 100 )
 		, m_button( ' ' )
@@ -123,8 +298,13 @@ public:
 		m_button = Math::Scalar< int >( button[ 0 ] );
 		m_inButton = Math::Scalar< int >( inButton[ 0 ] );
 
-		mean = Math::Vector< double, 7 >::zeros();
-		outProd = Math::Matrix< double, 7, 7 >::zeros( );
+		// one accumulator per input
+		for ( Graph::UTQLSubgraph::EdgeMap::iterator it = subgraph->m_Edges.begin(); it != subgraph->m_Edges.end(); it++ )
+			if ( it->second->isInput() && 0 == it->first.compare( 0, 14, "PerturbedInput" ) )
+				m_inPortsPerturbed.push_back( boost::shared_ptr< Dataflow::PushConsumer< EventType > >(
+					new Dataflow::PushConsumer< EventType >( it->first, *this,
+						boost::bind( &CovarianceEstimation::dataIn, this, _1, m_inPortsPerturbed.size() ) ) ) );
+		m_statistics.resize( m_inPortsPerturbed.size() );
     }
 
 
@@ -142,13 +322,15 @@ public:
 			if ( m_bStopped ) 
 			{
 				LOG4CPP_DEBUG( logger, getName() << " Received trigger event with timestamp " << e.time() << ". Invoke computation by sending first sync signal..." );
-				m_outPortSync.send( Measurement::Button( e.time(), m_button ) );
-				m_bStopped = false;
 
 				// Reset internal state
 				m_counter = 0;
-				mean = Math::Vector< double, 7 >::zeros();
-				outProd = Math::Matrix< double, 7, 7 >::zeros();
+				m_bReference = false;
+				for ( std::size_t i = 0; i < m_statistics.size(); i++ )
+					m_statistics[ i ].reset();
+
+				m_bStopped = false;
+				m_outPortSync.send( Measurement::Button( e.time(), m_button ) );
 			}
 			else 
 			{
@@ -169,32 +351,48 @@ public:
 	 * asynchronously. However, each push will result in an event to
 	 * be issued on the {@code Sync} output.
 	 */
-    void dataIn( const EventType& e )
+    void dataIn( const EventType& e, std::size_t input )
     {
 		LOG4CPP_TRACE( logger, getName() << " Received perturbed measurement with timestamp " << e.time() );
 
-		if ( m_bStopped ) 
+		RunningStatistics< N > total;
 		{
-			LOG4CPP_TRACE( logger, getName() << " Covariance estimation has not been triggered yet, ignore measurement" );
-			return;
-		}
-			
-		m_counter ++;
-		LOG4CPP_TRACE( logger, getName() << " Current counter: " << m_counter << ", go on until: " << m_size );
+			boost::mutex::scoped_lock l( m_mutex );
 
-		// Compute incremental covariance
-		typename ResultType::value_type estimate = incrementalEstimate ( *e );
+			if ( m_bStopped ) 
+			{
+				LOG4CPP_TRACE( logger, getName() << " Covariance estimation has not been triggered yet, ignore measurement" );
+				return;
+			}
 
-		// Check list size
-		if ( m_counter == m_size )
+			// Accumulate the sample, the first one defines the reference orientation
+			double x[ N ];
+			toSample( *e, x, m_bReference ? m_reference : 0 );
+			if ( !m_bReference && N == 7 )
+			{
+				for ( std::size_t i = 0; i < 4; i++ )
+					m_reference[ i ] = x[ 3 + i ];
+				m_bReference = true;
+			}
+			m_statistics[ input ].add( x );
+
+			m_counter ++;
+			LOG4CPP_TRACE( logger, getName() << " Current counter: " << m_counter << ", go on until: " << m_size );
+
+			// Check list size
+			if ( m_counter == m_size )
+			{
+				for ( std::size_t i = 0; i < m_statistics.size(); i++ )
+					total.merge( m_statistics[ i ] );
+				m_bStopped = true;
+			}
+		}
+
+		if ( total.count() )
 		{
 			// push onward final result
 			LOG4CPP_DEBUG( logger, getName() << " Terminate and push final result" );
-			m_outPortDist.send( ResultType ( e.time(), estimate ) );
-
-			boost::mutex::scoped_lock l( m_mutex );
-			m_bStopped = true;
-
+			m_outPortDist.send( ResultType ( e.time(), estimateFromStatistics( total, static_cast< typename ResultType::value_type* >( 0 ) ) ) );
 			return;
 		}
 		
@@ -205,10 +403,8 @@ public:
 	
 
 protected:
-	typename ResultType::value_type incrementalEstimate( typename EventType::value_type& perturbed );
-
-	/** Input port of the component. */
-	Dataflow::PushConsumer< EventType > m_inPortPerturbed;
+	/** Input ports of the component. */
+	std::vector< boost::shared_ptr< Dataflow::PushConsumer< EventType > > > m_inPortsPerturbed;
 	Dataflow::PushConsumer< Measurement::Button > m_inPortTrigger;
 
 	// Output ports of the component
@@ -218,8 +414,12 @@ protected:
 	// stop
 	bool m_bStopped;
 
-	Math::Vector< double > mean;
-	Math::Matrix< double, 0, 0 > outProd;
+	/** statistics of the samples of each input */
+	std::vector< RunningStatistics< N > > m_statistics;
+
+	/** orientation of the first sample, defines the quaternion hemisphere */
+	bool m_bReference;
+	double m_reference[ 4 ];
 
 	int m_counter;
 	int m_size;
@@ -231,116 +431,83 @@ protected:
 };
 
 
-template<>
-Math::ErrorVector< double, 3 > CovarianceEstimation< Measurement::Position, Measurement::ErrorPosition >::incrementalEstimate( Math::Vector< double, 3 >& posNew )
-{
-	ublas::vector_range< typename Math::Vector< double >::base_type > posMean ( mean, ublas::range( 0, 3 ) );
-	ublas::matrix_range< typename Math::Matrix< double, 0, 0 >::base_type > outProd3 ( outProd, ublas::range ( 0, 3 ), ublas::range ( 0, 3 ) );
-
- 	// Running mean value of position random variable
- 	posMean = ( ( ((double)m_counter - 1) / (double)m_counter ) * posMean ) + ( ( 1 / (double)m_counter ) * posNew );
-
-	// Running outer product of position random variable (not yet normalized by number of measurements)
- 	outProd3 = outProd3 + ublas::outer_prod( posNew, posNew );
-
- 	// Compute covariance matrix
- 	if ( m_counter == 1 ) 
- 	{
- 		LOG4CPP_TRACE( logger, "Not enough data to compute covariance matrix" );
- 		return Math::ErrorVector< double, 3 >();
- 	}
-
- 	Math::ErrorVector< double, 3 > ev ( posMean, outProd3 / ((double)m_counter) - ublas::outer_prod ( posMean, posMean ) );
-
-	LOG4CPP_TRACE( logger, "Running (empirical) mean / covariance: " << std::endl << ev );
-
- 	return ev;
-}
-
-
-template<>
-Math::ErrorPose CovarianceEstimation< Measurement::Pose, Measurement::ErrorPose >::incrementalEstimate( Math::Pose& poseNew )
+/**
+ * @ingroup dataflow_components
+ * Covariance estimation component for lists of samples
+ *
+ * @par Input Ports
+ * PushConsumer< ListType > with name "PerturbedInput".
+ *
+ * @par Output Ports
+ * PushSupplier< ResultType > with name "Distribution".
+ *
+ * @par Operation
+ *
+ * Determines mean and covariance of all samples in each list pushed on
+ * {@code PerturbedInput} and pushes the result on {@code Distribution}.
+ * Together with a batch perturbation component, a complete Monte Carlo
+ * estimation takes a single pass through the dataflow. The moments are
+ * accumulated like in CovarianceEstimation.
+ */
+template< class ListType, class ResultType >
+class ListCovarianceEstimation
+	: public Dataflow::Component
 {
-	ublas::vector_range< typename Math::Vector< double >::base_type > posMean( mean, ublas::range( 0, 3 ) );
-	ublas::vector_range< typename Math::Vector< double >::base_type > rotMean( mean, ublas::range( 3, 7 ) );
-
-	LOG4CPP_TRACE ( logger, "Update pose event: " << poseNew );
+public:
+	static const std::size_t N = SampleSize< typename ListType::value_type::value_type >::value;
 
-	// The order is tx, ty, tz, qx, qy, qz, qw.
-	Math::Vector< double > poseNewVec( 7 );
-	poseNew.toVector( poseNewVec );
-	ublas::vector_range< typename Math::Vector< double >::base_type > posNew( poseNewVec, ublas::range( 0, 3 ) );
-	ublas::vector_range< typename Math::Vector< double >::base_type > rotNew( poseNewVec, ublas::range( 3, 7 ) );
+	/**
+	 * UTQL component constructor.
+	 *
+	 * @param sName Unique name of the component.
+	 * @param subgraph UTQL subgraph
+	 */
+	ListCovarianceEstimation( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
+		: Dataflow::Component( sName )
+		, m_inPortPerturbed( "PerturbedInput", *this, boost::bind( &ListCovarianceEstimation::dataIn, this, _1 ) )
+		, m_outPortDist ( "Distribution", *this )
+	{
+	}
 
-	// Take care of quaternion ambiguity
- 	if ( ublas::inner_prod( rotNew, rotMean ) < 0 )
- 		rotNew *= -1;
+	void dataIn( const ListType& e )
+	{
+		if ( e->size() < 2 )
+		{
+			LOG4CPP_WARN( logger, getName() << " Not enough samples to compute covariance matrix" );
+			return;
+		}
 
-	// Update running mean value
-	mean = ( ( ((double)m_counter - 1) / (double)m_counter ) * mean ) + ( ( 1 / (double)m_counter ) * poseNewVec );
+		LOG4CPP_DEBUG( logger, getName() << " Estimating covariance of " << e->size() << " samples" );
 
-	// Running outer product of pose random variable (not yet normalized by number of measurements)
-	outProd = outProd + ublas::outer_prod( poseNewVec, poseNewVec );
+		// the first sample defines the quaternion hemisphere, if there is one
+		double first[ 7 ];
+		double x[ N ];
+		toSample( ( *e )[ 0 ], first, 0 );
 
-	/*
-	 * Use inverted mean value to transform the additive 7x7
-	 * covariance to the 6x6 multiplicative format The conversion is
-	 * conducted according to the following formulas:
-	 * 
-	 * q_m = q_0 * ( q_id + q_e )
-	 * 
-	 * where q_id is the identity quaternion and q_e is a quaternion
-	 * with expectation ((0,0,0),0) and a covariance covering only the
-	 * imaginary part. Together ( q_id + q_e ) represent a small
-	 * quaternion ((e_rx, e_ry, e_rz), 1). If mean and covariance of
-	 * the quaternion are estimated according to the usual formulas,
-	 * however, one gets the following instead:
-	 * 
-	 * q_m = q_0 + q'_e
-	 * 
-	 * Together with the first formula, this yields
-	 * 
-	 * q_0 * ( q_id + q_e ) = q_0 + q'_e
-	 * ( q_id + q_e )       = ~q_0 * q_0 + ~q_0 * q'_e
-	 * q_e                  = q_id + ~q_0 * q'_e - q_id
-	 * q_e                  = ~q_0 * q'_e
-	 *
-	 * Thus, one has to rotate the distribution by ~q_0. The variance
-	 * of the real part can then be discarded, it should be ~0.
-	 */
-
-	Math::Vector< double, 7 > invMean;
-	(~(Math::Pose::fromVector( mean ) ) ).toVector( invMean );
-	Math::ErrorVector< double, 7 > ev ( invMean, outProd / ( (double)m_counter ) - ublas::outer_prod ( mean, mean ) );
-	Math::ErrorPose invEp = Math::ErrorPose::fromAdditiveErrorVector( ev );
-	
-	// We created the error pose from the inverted mean value above, to obtain the transformed 6x6 covariance
-	// Now, we recreate the error pose with the computed mean value.
-	Math::ErrorPose ep( Math::Pose::fromVector( mean ), invEp.covariance() );
+		RunningStatistics< N > stats;
+		for ( std::size_t i = 0; i < e->size(); i++ )
+		{
+			toSample( ( *e )[ i ], x, first + 3 );
+			stats.add( x );
+		}
 
-	LOG4CPP_TRACE( logger, "Running (empirical) mean / covariance: " << std::endl << ep );
+		m_outPortDist.send( ResultType( e.time(), estimateFromStatistics( stats, static_cast< typename ResultType::value_type* >( 0 ) ) ) );
+	}
 
-	// For debug purposes, compute positional and angular error...
-	Math::Matrix< double, 6, 6 > covar = ep.covariance();
-	double posRms = sqrt ( covar (0,0) + covar (1,1) + covar (2,2) );
-	LOG4CPP_INFO( logger, "RMS positional error [mm]: " << posRms );
-	Math::Vector< double, 3 > axis;
-	axis (0) = sqrt ( covar (3,3) );
-	axis (1) = sqrt ( covar (4,4) );
-	axis (2) = sqrt ( covar (5,5) );
-	double norm = norm_2 (axis);
-	double phi = asin ( norm ) * 2;
-	phi = phi * 180 / boost::math::constants::pi<double>();
-	LOG4CPP_INFO( logger, "Standard deviation of rotational error [deg]: " << phi );
-	
-	return ep;
-}
+protected:
+	/** Input port of the component. */
+	Dataflow::PushConsumer< ListType > m_inPortPerturbed;
 
+	// Output ports of the component
+	Dataflow::PushSupplier< ResultType > m_outPortDist;
+};
 
 
 UBITRACK_REGISTER_COMPONENT( Dataflow::ComponentFactory* const cf ) {
 	cf->registerComponent< CovarianceEstimation< Measurement::Pose, Measurement::ErrorPose > > ( "PoseCovarianceEstimation" );
 	cf->registerComponent< CovarianceEstimation< Measurement::Position, Measurement::ErrorPosition > > ( "3DPositionCovarianceEstimation" );
+	cf->registerComponent< ListCovarianceEstimation< Measurement::PoseList, Measurement::ErrorPose > > ( "PoseListCovarianceEstimation" );
+	cf->registerComponent< ListCovarianceEstimation< Measurement::PositionList, Measurement::ErrorPosition > > ( "3DPositionListCovarianceEstimation" );
 }
 
 } } // Namespace Ubitrack::Components
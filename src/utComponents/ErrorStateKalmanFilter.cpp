@@ -0,0 +1,228 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Component for error-state kalman filtering of poses and gyroscopes
+ */
+
+#include <boost/bind.hpp>
+#include <log4cpp/Category.hh>
+
+#include <utDataflow/Component.h>
+#include <utDataflow/PushConsumer.h>
+#include <utDataflow/PullSupplier.h>
+#include <utDataflow/PushSupplier.h>
+#include <utDataflow/ComponentFactory.h>
+#include <utMeasurement/Measurement.h>
+
+#include "ErrorStateKalmanFilter.h"
+
+// get a logger
+static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Events.Components.ErrorStateKalmanFilter" ) );
+
+namespace Ubitrack { namespace Components {
+
+/**
+ * inverts a pose with covariance of position and rotation vector error.
+ * z and zi contain position and quaternion.
+ */
+inline void invertPose( const double* z, const FixedMatrix< 6, 6 >& cov, double* zi, FixedMatrix< 6, 6 >& covi )
+{
+	FixedMatrix< 3, 3 > r;
+	quaternionRotationMatrix( z + 3, r );
+
+	double t[ 3 ];
+	for ( std::size_t i = 0; i < 3; i++ )
+	{
+		t[ i ] = r( 0, i ) * z[ 0 ] + r( 1, i ) * z[ 1 ] + r( 2, i ) * z[ 2 ];
+		zi[ i ] = -t[ i ];
+		zi[ 3 + i ] = -z[ 3 + i ];
+	}
+	zi[ 6 ] = z[ 6 ];
+
+	// jacobian of the inverse w.r.t. position and rotation errors: [ -R^T, -[R^T t]x; 0, -R ]
+	FixedMatrix< 6, 6 > j( FixedMatrix< 6, 6 >::zeros() );
+	for ( std::size_t i = 0; i < 3; i++ )
+		for ( std::size_t k = 0; k < 3; k++ )
+		{
+			j( i, k ) = -r( k, i );
+			j( 3 + i, 3 + k ) = -r( i, k );
+		}
+	addSkew( t, -1.0, j, 0, 3 );
+
+	similarity( j, cov, covi );
+}
+
+
+/**
+ * @ingroup dataflow_components
+ * Error-state kalman filter for optical poses and gyroscopes.
+ *
+ * @par Input Ports
+ * PushConsumer< ErrorPose > with name "InPose".
+ * PushConsumer< RotationVelocity > with name "InRotationVelocity".
+ *
+ * @par Output Ports
+ * PullSupplier< ErrorPose > with name "OutPose".
+ * PushSupplier< ErrorPose > with name "OutPosePush".
+ *
+ * @par Configuration
+ * - DataflowConfiguration Attribute "insideOut": "true" if the poses are poses of the world in the frame
+ *   of the gyroscope, "false" (default) if they are poses of the gyroscope in the world.
+ * - DataflowConfiguration Attribute "accelerationNoise": acceleration noise in m/s^2/sqrt(Hz), default 1
+ * - DataflowConfiguration Attribute "gyroNoise": gyroscope noise in rad/s/sqrt(Hz), default 0.01
+ * - DataflowConfiguration Attribute "gyroBiasNoise": gyroscope bias random walk in rad/s/sqrt(s), default 0.0001
+ * - DataflowConfiguration Attribute "orientationNoise": additional orientation random walk in rad/sqrt(s), default 0.05
+ *
+ * @par Operation
+ * See ErrorStateKalmanFilter. The gyroscope must be calibrated to the tracked body, rotation velocities are
+ * expected in the body frame in rad/s. Gyroscope samples only update the preintegrated rotation, the full
+ * filter step is done when a pose arrives or a pose is pulled.
+ * Poses are pushed for the time of each pose measurement.
+ */
+class ErrorStateKalmanFilterComponent
+	: public Dataflow::Component
+{
+public:
+	/**
+	 * UTQL component constructor.
+	 *
+	 * @param sName Unique name of the component.
+	 * @param subgraph UTQL subgraph
+	 */
+	ErrorStateKalmanFilterComponent( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
+		: Dataflow::Component( sName )
+		, m_inPose( "InPose", *this, boost::bind( &ErrorStateKalmanFilterComponent::receivePose, this, _1 ) )
+		, m_inRotationVelocity( "InRotationVelocity", *this, boost::bind( &ErrorStateKalmanFilterComponent::receiveRotationVelocity, this, _1 ) )
+		, m_out( "OutPose", *this, boost::bind( &ErrorStateKalmanFilterComponent::sendOut, this, _1 ) )
+		, m_outPush( "OutPosePush", *this )
+		, m_bInsideOut( subgraph->m_DataflowAttributes.getAttributeString( "insideOut" ) == "true" )
+		, m_filter( getAttribute( subgraph, "accelerationNoise", 1.0 ), getAttribute( subgraph, "gyroNoise", 0.01 ),
+			getAttribute( subgraph, "gyroBiasNoise", 1e-4 ), getAttribute( subgraph, "orientationNoise", 0.05 ) )
+	{
+	}
+
+	/** integrates a pose measurement */
+	void receivePose( const Measurement::ErrorPose& m )
+	{
+		LOG4CPP_DEBUG( logger, "Received pose measurement: " << m );
+
+		// convert to position and rotation vector error
+		double z[ 7 ];
+		FixedMatrix< 6, 6 > cov;
+		for ( std::size_t i = 0; i < 3; i++ )
+			z[ i ] = m->translation()( i );
+		z[ 3 ] = m->rotation().x();
+		z[ 4 ] = m->rotation().y();
+		z[ 5 ] = m->rotation().z();
+		z[ 6 ] = m->rotation().w();
+		for ( std::size_t i = 0; i < 6; i++ )
+			for ( std::size_t j = 0; j < 6; j++ )
+				cov( i, j ) = m->covariance()( i, j ) * ( i < 3 ? 1.0 : 2.0 ) * ( j < 3 ? 1.0 : 2.0 );
+
+		if ( m_bInsideOut )
+		{
+			double zi[ 7 ];
+			FixedMatrix< 6, 6 > covi;
+			invertPose( z, cov, zi, covi );
+			m_filter.addPoseMeasurement( m.time(), zi, covi );
+		}
+		else
+			m_filter.addPoseMeasurement( m.time(), z, cov );
+
+		if ( m_outPush.isConnected() && m_inPose.getQueuedEvents() == 0 )
+			m_outPush.send( sendOut( m.time() ) );
+	}
+
+	/** integrates a gyroscope measurement */
+	void receiveRotationVelocity( const Measurement::RotationVelocity& m )
+	{
+		double omega[ 3 ] = { ( *m )( 0 ), ( *m )( 1 ), ( *m )( 2 ) };
+		m_filter.addRotationVelocityMeasurement( m.time(), omega );
+	}
+
+	/** Method that returns a predicted measurement. */
+	Measurement::ErrorPose sendOut( Measurement::Timestamp t )
+	{
+		ErrorStateKalmanFilter::State s( m_filter.predict( t ) );
+
+		static const std::size_t index[ 6 ] = { 0, 1, 2, 6, 7, 8 };
+		double z[ 7 ];
+		FixedMatrix< 6, 6 > cov;
+		for ( std::size_t i = 0; i < 3; i++ )
+			z[ i ] = s.position[ i ];
+		for ( std::size_t i = 0; i < 4; i++ )
+			z[ 3 + i ] = s.rotation[ i ];
+		for ( std::size_t i = 0; i < 6; i++ )
+			for ( std::size_t j = 0; j < 6; j++ )
+				cov( i, j ) = s.covariance( index[ i ], index[ j ] );
+
+		if ( m_bInsideOut )
+		{
+			double zi[ 7 ];
+			FixedMatrix< 6, 6 > covi;
+			invertPose( z, cov, zi, covi );
+			return makeErrorPose( t, zi, covi );
+		}
+		return makeErrorPose( t, z, cov );
+	}
+
+protected:
+	/** creates an ErrorPose from position, quaternion and the covariance of position and rotation vector error */
+	static Measurement::ErrorPose makeErrorPose( Measurement::Timestamp t, const double* z, const FixedMatrix< 6, 6 >& cov )
+	{
+		Math::Matrix< double, 6, 6 > covariance;
+		for ( std::size_t i = 0; i < 6; i++ )
+			for ( std::size_t j = 0; j < 6; j++ )
+				covariance( i, j ) = cov( i, j ) * ( i < 3 ? 1.0 : 0.5 ) * ( j < 3 ? 1.0 : 0.5 );
+
+		Math::Pose pose( Math::Quaternion( z[ 3 ], z[ 4 ], z[ 5 ], z[ 6 ] ), Math::Vector< double, 3 >( z[ 0 ], z[ 1 ], z[ 2 ] ) );
+		return Measurement::ErrorPose( t, Math::ErrorPose( pose, covariance ) );
+	}
+
+	static double getAttribute( boost::shared_ptr< Graph::UTQLSubgraph > subgraph, const std::string& name, double value )
+	{
+		subgraph->m_DataflowAttributes.getAttributeData( name, value );
+		return value;
+	}
+
+	Dataflow::PushConsumer< Measurement::ErrorPose > m_inPose;
+	Dataflow::PushConsumer< Measurement::RotationVelocity > m_inRotationVelocity;
+	Dataflow::PullSupplier< Measurement::ErrorPose > m_out;
+	Dataflow::PushSupplier< Measurement::ErrorPose > m_outPush;
+
+	/** are the poses inverted? */
+	bool m_bInsideOut;
+
+	ErrorStateKalmanFilter m_filter;
+};
+
+
+UBITRACK_REGISTER_COMPONENT( Dataflow::ComponentFactory* const cf ) {
+	cf->registerComponent< ErrorStateKalmanFilterComponent > ( "ErrorStateKalmanFilter" );
+}
+
+} } // namespace Ubitrack::Components
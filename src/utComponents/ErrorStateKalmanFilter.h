@@ -0,0 +1,326 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#ifndef __UBITRACK_COMPONENTS_ERRORSTATEKALMANFILTER_H_INCLUDED__
+#define __UBITRACK_COMPONENTS_ERRORSTATEKALMANFILTER_H_INCLUDED__
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Error-state kalman filter for poses and gyroscopes
+ */
+
+#include <cmath>
+#include <utMeasurement/Measurement.h>
+#include <utUtil/Exception.h>
+
+#include "FixedMatrix.h"
+#include "FixedQuaternion.h"
+#include "GyroPreintegration.h"
+
+namespace Ubitrack { namespace Components {
+
+/** skew-symmetric cross product matrix of v, added to r at ( row, col ) with a factor */
+template< std::size_t R, std::size_t C >
+inline void addSkew( const double* v, double factor, FixedMatrix< R, C >& r, std::size_t row, std::size_t col )
+{
+	r( row, col + 1 ) -= factor * v[ 2 ]; r( row, col + 2 ) += factor * v[ 1 ];
+	r( row + 1, col ) += factor * v[ 2 ]; r( row + 1, col + 2 ) -= factor * v[ 0 ];
+	r( row + 2, col ) -= factor * v[ 1 ]; r( row + 2, col + 1 ) += factor * v[ 0 ];
+}
+
+
+/**
+ * @ingroup dataflow_components
+ * Error-state kalman filter fusing absolute poses with gyroscope measurements.
+ *
+ * The nominal state consists of position, velocity, orientation and gyro bias of the tracked body.
+ * The filter estimates the 12-dimensional error of that state: position, velocity, rotation vector
+ * of a right-multiplied error rotation and gyro bias. The orientation is therefore always a unit
+ * quaternion and the error is minimal and close to zero, which keeps the linearization accurate.
+ *
+ * Gyro samples are preintegrated. The error covariance is only propagated when a pose is integrated
+ * or a prediction is requested, with a cost independent of the number of gyro samples in between.
+ * Positions follow a constant-velocity model driven by white acceleration noise.
+ */
+class ErrorStateKalmanFilter
+{
+public:
+	typedef FixedMatrix< 12, 12 > CovarianceMatrix;
+
+	/** position, velocity, orientation and gyro bias with the error covariance */
+	struct State
+	{
+		double position[ 3 ];
+		double velocity[ 3 ];
+		double rotation[ 4 ];
+		double bias[ 3 ];
+		CovarianceMatrix covariance;
+		Measurement::Timestamp time;
+	};
+
+	/**
+	 * @param accelerationNoise standard deviation of the acceleration noise in m/s^2/sqrt(Hz)
+	 * @param gyroNoise standard deviation of the gyro noise in rad/s/sqrt(Hz)
+	 * @param biasNoise standard deviation of the gyro bias random walk in rad/s/sqrt(s)
+	 * @param orientationNoise standard deviation of an additional orientation random walk in rad/sqrt(s),
+	 *   which also models the motion when no gyro is connected
+	 */
+	ErrorStateKalmanFilter( double accelerationNoise, double gyroNoise, double biasNoise, double orientationNoise )
+		: m_accelerationVariance( accelerationNoise * accelerationNoise )
+		, m_gyroVariance( gyroNoise * gyroNoise )
+		, m_biasVariance( biasNoise * biasNoise )
+		, m_orientationVariance( orientationNoise * orientationNoise )
+		, m_bInitialized( false )
+		, m_bHaveGyro( false )
+		, m_gyroTime( 0 )
+	{}
+
+	bool isInitialized() const
+	{ return m_bInitialized; }
+
+	/**
+	 * integrates a pose measurement.
+	 * @param z position and quaternion
+	 * @param cov covariance of position and rotation vector error
+	 */
+	void addPoseMeasurement( Measurement::Timestamp t, const double* z, const FixedMatrix< 6, 6 >& cov )
+	{
+		if ( !m_bInitialized )
+		{
+			initialize( t, z, cov );
+			return;
+		}
+
+		if ( t > m_state.time )
+		{
+			propagate( m_state, t );
+			m_preintegration.reset();
+		}
+
+		// innovation of position and rotation vector
+		double innovation[ 6 ];
+		for ( std::size_t i = 0; i < 3; i++ )
+			innovation[ i ] = z[ i ] - m_state.position[ i ];
+
+		double inverse[ 4 ] = { -m_state.rotation[ 0 ], -m_state.rotation[ 1 ], -m_state.rotation[ 2 ], m_state.rotation[ 3 ] };
+		double error[ 4 ];
+		quaternionMultiply( inverse, z + 3, error );
+		double sign = error[ 3 ] < 0 ? -2.0 : 2.0;
+		for ( std::size_t i = 0; i < 3; i++ )
+			innovation[ 3 + i ] = sign * error[ i ];
+
+		// S = H P H^T + R, with H selecting the position and rotation errors
+		static const std::size_t index[ 6 ] = { 0, 1, 2, 6, 7, 8 };
+		FixedMatrix< 6, 6 > s;
+		FixedMatrix< 6, 12 > hp;
+		for ( std::size_t i = 0; i < 6; i++ )
+		{
+			for ( std::size_t j = 0; j < 6; j++ )
+				s( i, j ) = m_state.covariance( index[ i ], index[ j ] ) + cov( i, j );
+			for ( std::size_t j = 0; j < 12; j++ )
+				hp( i, j ) = m_state.covariance( index[ i ], j );
+		}
+
+		FixedMatrix< 6, 6 > l;
+		if ( !cholesky( s, l ) )
+			return;
+
+		// K^T = S^-1 H P
+		FixedMatrix< 6, 12 > kt( hp );
+		choleskySolve( l, kt );
+
+		double dx[ 12 ];
+		for ( std::size_t i = 0; i < 12; i++ )
+		{
+			dx[ i ] = 0.0;
+			for ( std::size_t k = 0; k < 6; k++ )
+				dx[ i ] += kt( k, i ) * innovation[ k ];
+		}
+
+		// P -= ( H P )^T S^-1 ( H P )
+		for ( std::size_t i = 0; i < 12; i++ )
+			for ( std::size_t j = i; j < 12; j++ )
+			{
+				double sum = 0.0;
+				for ( std::size_t k = 0; k < 6; k++ )
+					sum += hp( k, i ) * kt( k, j );
+				m_state.covariance( i, j ) -= sum;
+			}
+		m_state.covariance.symmetrize();
+
+		// inject the error into the nominal state
+		double dq[ 4 ];
+		quaternionExp( dx + 6, dq );
+		quaternionMultiply( m_state.rotation, dq, m_state.rotation );
+		for ( std::size_t i = 0; i < 3; i++ )
+		{
+			m_state.position[ i ] += dx[ i ];
+			m_state.velocity[ i ] += dx[ 3 + i ];
+			m_state.bias[ i ] += dx[ 9 + i ];
+		}
+	}
+
+	/** integrates a body-frame angular velocity in rad/s, valid from time t until the next sample */
+	void addRotationVelocityMeasurement( Measurement::Timestamp t, const double* omega )
+	{
+		if ( m_bInitialized && m_bHaveGyro && t > m_gyroTime )
+			integrateGyro( m_preintegration, t );
+
+		if ( !m_bHaveGyro || t > m_gyroTime )
+		{
+			for ( std::size_t i = 0; i < 3; i++ )
+				m_omega[ i ] = omega[ i ];
+			m_gyroTime = t;
+			m_bHaveGyro = true;
+		}
+	}
+
+	/** returns the state predicted to time t, without changing the filter */
+	State predict( Measurement::Timestamp t ) const
+	{
+		if ( !m_bInitialized )
+			UBITRACK_THROW( "Kalman filter has not been initialized" );
+
+		State s( m_state );
+		if ( t > s.time )
+			propagate( s, t );
+		return s;
+	}
+
+	const State& getState() const
+	{ return m_state; }
+
+protected:
+	void initialize( Measurement::Timestamp t, const double* z, const FixedMatrix< 6, 6 >& cov )
+	{
+		for ( std::size_t i = 0; i < 3; i++ )
+		{
+			m_state.position[ i ] = z[ i ];
+			m_state.velocity[ i ] = 0.0;
+			m_state.bias[ i ] = 0.0;
+		}
+		for ( std::size_t i = 0; i < 4; i++ )
+			m_state.rotation[ i ] = z[ 3 + i ];
+
+		static const std::size_t index[ 6 ] = { 0, 1, 2, 6, 7, 8 };
+		m_state.covariance.setZero();
+		for ( std::size_t i = 0; i < 6; i++ )
+			for ( std::size_t j = 0; j < 6; j++ )
+				m_state.covariance( index[ i ], index[ j ] ) = cov( i, j );
+		for ( std::size_t i = 0; i < 3; i++ )
+		{
+			m_state.covariance( 3 + i, 3 + i ) = 1.0;
+			m_state.covariance( 9 + i, 9 + i ) = 1e-2;
+		}
+
+		m_state.time = t;
+		m_preintegration.reset();
+		m_bInitialized = true;
+	}
+
+	/** integrates the last gyro sample from the later of its time and the state time until t */
+	void integrateGyro( GyroPreintegration& preintegration, Measurement::Timestamp t ) const
+	{
+		Measurement::Timestamp start( std::max( m_gyroTime, m_state.time ) );
+		if ( t <= start )
+			return;
+
+		double omega[ 3 ];
+		for ( std::size_t i = 0; i < 3; i++ )
+			omega[ i ] = m_omega[ i ] - m_state.bias[ i ];
+		preintegration.integrate( omega, ( t - start ) * 1e-9, m_gyroVariance );
+	}
+
+	/** propagates state s from its time to t using the preintegrated gyro samples */
+	void propagate( State& s, Measurement::Timestamp t ) const
+	{
+		GyroPreintegration preintegration( m_preintegration );
+		if ( m_bHaveGyro )
+			integrateGyro( preintegration, t );
+
+		double dt = ( t - s.time ) * 1e-9;
+
+		// nominal state
+		for ( std::size_t i = 0; i < 3; i++ )
+			s.position[ i ] += s.velocity[ i ] * dt;
+		quaternionMultiply( s.rotation, preintegration.rotation(), s.rotation );
+		double n = std::sqrt( s.rotation[ 0 ] * s.rotation[ 0 ] + s.rotation[ 1 ] * s.rotation[ 1 ] +
+			s.rotation[ 2 ] * s.rotation[ 2 ] + s.rotation[ 3 ] * s.rotation[ 3 ] );
+		for ( std::size_t i = 0; i < 4; i++ )
+			s.rotation[ i ] /= n;
+
+		// error state transition
+		FixedMatrix< 12, 12 > f( FixedMatrix< 12, 12 >::identity() );
+		FixedMatrix< 3, 3 > r;
+		quaternionRotationMatrix( preintegration.rotation(), r );
+		for ( std::size_t i = 0; i < 3; i++ )
+		{
+			f( i, 3 + i ) = dt;
+			for ( std::size_t j = 0; j < 3; j++ )
+			{
+				f( 6 + i, 6 + j ) = r( j, i );
+				f( 6 + i, 9 + j ) = preintegration.biasJacobian()( i, j );
+			}
+		}
+
+		CovarianceMatrix p;
+		similarity( f, s.covariance, p );
+
+		// process noise
+		for ( std::size_t i = 0; i < 3; i++ )
+		{
+			p( i, i ) += m_accelerationVariance * dt * dt * dt / 3;
+			p( i, 3 + i ) += m_accelerationVariance * dt * dt / 2;
+			p( 3 + i, i ) += m_accelerationVariance * dt * dt / 2;
+			p( 3 + i, 3 + i ) += m_accelerationVariance * dt;
+			for ( std::size_t j = 0; j < 3; j++ )
+				p( 6 + i, 6 + j ) += preintegration.covariance()( i, j );
+			p( 6 + i, 6 + i ) += m_orientationVariance * dt;
+			p( 9 + i, 9 + i ) += m_biasVariance * dt;
+		}
+
+		s.covariance = p;
+		s.time = t;
+	}
+
+	double m_accelerationVariance;
+	double m_gyroVariance;
+	double m_biasVariance;
+	double m_orientationVariance;
+
+	bool m_bInitialized;
+	State m_state;
+
+	/** gyro samples since the state time */
+	GyroPreintegration m_preintegration;
+
+	/** last gyro sample */
+	bool m_bHaveGyro;
+	Measurement::Timestamp m_gyroTime;
+	double m_omega[ 3 ];
+};
+
+} } // namespace Ubitrack::Components
+
+#endif
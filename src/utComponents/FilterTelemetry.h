@@ -0,0 +1,155 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#ifndef __UBITRACK_COMPONENTS_FILTERTELEMETRY_H_INCLUDED__
+#define __UBITRACK_COMPONENTS_FILTERTELEMETRY_H_INCLUDED__
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Ring buffer of filter update statistics
+ */
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <utMeasurement/Measurement.h>
+
+namespace Ubitrack { namespace Components {
+
+/** statistics of a single filter update */
+struct FilterTelemetryRecord
+{
+	/** timestamp of the measurement */
+	Measurement::Timestamp time;
+
+	/** index of the input port */
+	std::size_t port;
+
+	/** norm of the innovation, negative if not available */
+	double innovation;
+
+	/** normalized innovation squared, negative if not available */
+	double nis;
+
+	/** age of the measurement when the update started in ms */
+	double age;
+
+	/** duration of the update in ms */
+	double duration;
+};
+
+
+/**
+ * @ingroup dataflow_components
+ * Fixed-size ring of filter update statistics.
+ *
+ * Records are written and dumped by the thread that delivers the measurements, so neither
+ * needs locking. Adding a record only copies it into the ring, all formatting is deferred
+ * until the telemetry is dumped.
+ */
+class FilterTelemetry
+{
+public:
+	/** @param size number of records kept, 0 disables the telemetry */
+	FilterTelemetry( std::size_t size = 0 )
+		: m_records( size )
+		, m_next( 0 )
+		, m_count( 0 )
+	{}
+
+	bool enabled() const
+	{ return !m_records.empty(); }
+
+	/** registers an input port, returns its index */
+	std::size_t addPort( const std::string& name )
+	{
+		m_ports.push_back( name );
+		return m_ports.size() - 1;
+	}
+
+	void add( const FilterTelemetryRecord& r )
+	{
+		m_records[ m_next ] = r;
+		m_next = ( m_next + 1 ) % m_records.size();
+		m_count = std::min( m_count + 1, m_records.size() );
+	}
+
+	/** writes a per-port summary and the recorded updates, oldest first */
+	void dump( std::ostream& s ) const
+	{
+		std::size_t first = ( m_next + m_records.size() - m_count ) % std::max< std::size_t >( 1, m_records.size() );
+
+		for ( std::size_t p = 0; p < m_ports.size(); p++ )
+		{
+			std::size_t n = 0, nNis = 0;
+			double nis = 0, duration = 0, maxDuration = 0, age = 0;
+			for ( std::size_t i = 0; i < m_count; i++ )
+			{
+				const FilterTelemetryRecord& r( m_records[ ( first + i ) % m_records.size() ] );
+				if ( r.port != p )
+					continue;
+				n++;
+				duration += r.duration;
+				maxDuration = std::max( maxDuration, r.duration );
+				age += r.age;
+				if ( r.nis >= 0 )
+				{
+					nis += r.nis;
+					nNis++;
+				}
+			}
+			if ( !n )
+				continue;
+
+			s << m_ports[ p ] << ": " << n << " updates, mean age " << age / n << "ms, mean duration " << duration / n
+				<< "ms, max duration " << maxDuration << "ms";
+			if ( nNis )
+				s << ", mean NIS " << nis / nNis;
+			s << std::endl;
+		}
+
+		s << "time port innovation nis age duration" << std::endl;
+		for ( std::size_t i = 0; i < m_count; i++ )
+		{
+			const FilterTelemetryRecord& r( m_records[ ( first + i ) % m_records.size() ] );
+			s << r.time << " " << m_ports[ r.port ] << " " << r.innovation << " " << r.nis << " "
+				<< r.age << " " << r.duration << std::endl;
+		}
+	}
+
+protected:
+	std::vector< FilterTelemetryRecord > m_records;
+	std::vector< std::string > m_ports;
+
+	/** index of the next record to write */
+	std::size_t m_next;
+
+	/** number of valid records */
+	std::size_t m_count;
+};
+
+} } // namespace Ubitrack::Components
+
+#endif
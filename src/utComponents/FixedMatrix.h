@@ -0,0 +1,213 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#ifndef __UBITRACK_COMPONENTS_FIXEDMATRIX_H_INCLUDED__
+#define __UBITRACK_COMPONENTS_FIXEDMATRIX_H_INCLUDED__
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Small fixed-size matrices for filters
+ */
+
+#include <cstddef>
+#include <cmath>
+#include <ostream>
+
+namespace Ubitrack { namespace Components {
+
+/**
+ * @ingroup dataflow_components
+ * Fixed-size matrix stored on the stack in row-major order.
+ *
+ * This is intended for the inner loops of filters, where the sizes are known at compile time
+ * and the allocations and expression templates of dynamic uBLAS matrices dominate the cost.
+ * Vectors are matrices with one column.
+ */
+template< std::size_t R, std::size_t C >
+struct FixedMatrix
+{
+	double m[ R ][ C ];
+
+	double& operator()( std::size_t i, std::size_t j )
+	{ return m[ i ][ j ]; }
+
+	double operator()( std::size_t i, std::size_t j ) const
+	{ return m[ i ][ j ]; }
+
+	/** vector access */
+	double& operator[]( std::size_t i )
+	{ return m[ i ][ 0 ]; }
+
+	double operator[]( std::size_t i ) const
+	{ return m[ i ][ 0 ]; }
+
+	void setZero()
+	{
+		for ( std::size_t i = 0; i < R; i++ )
+			for ( std::size_t j = 0; j < C; j++ )
+				m[ i ][ j ] = 0.0;
+	}
+
+	void setIdentity()
+	{
+		setZero();
+		for ( std::size_t i = 0; i < R && i < C; i++ )
+			m[ i ][ i ] = 1.0;
+	}
+
+	static FixedMatrix zeros()
+	{
+		FixedMatrix r;
+		r.setZero();
+		return r;
+	}
+
+	static FixedMatrix identity()
+	{
+		FixedMatrix r;
+		r.setIdentity();
+		return r;
+	}
+
+	/** copies the upper triangle to the lower triangle */
+	void symmetrize()
+	{
+		for ( std::size_t i = 1; i < R; i++ )
+			for ( std::size_t j = 0; j < i; j++ )
+				m[ i ][ j ] = m[ j ][ i ];
+	}
+};
+
+
+/** r = a * b */
+template< std::size_t R, std::size_t K, std::size_t C >
+inline void multiply( const FixedMatrix< R, K >& a, const FixedMatrix< K, C >& b, FixedMatrix< R, C >& r )
+{
+	for ( std::size_t i = 0; i < R; i++ )
+		for ( std::size_t j = 0; j < C; j++ )
+		{
+			double s = 0.0;
+			for ( std::size_t k = 0; k < K; k++ )
+				s += a.m[ i ][ k ] * b.m[ k ][ j ];
+			r.m[ i ][ j ] = s;
+		}
+}
+
+/** r = a * b^T */
+template< std::size_t R, std::size_t K, std::size_t C >
+inline void multiplyTransposed( const FixedMatrix< R, K >& a, const FixedMatrix< C, K >& b, FixedMatrix< R, C >& r )
+{
+	for ( std::size_t i = 0; i < R; i++ )
+		for ( std::size_t j = 0; j < C; j++ )
+		{
+			double s = 0.0;
+			for ( std::size_t k = 0; k < K; k++ )
+				s += a.m[ i ][ k ] * b.m[ j ][ k ];
+			r.m[ i ][ j ] = s;
+		}
+}
+
+/** r = a * p * a^T for symmetric p, only computing the upper triangle of the symmetric result */
+template< std::size_t R, std::size_t N >
+inline void similarity( const FixedMatrix< R, N >& a, const FixedMatrix< N, N >& p, FixedMatrix< R, R >& r )
+{
+	FixedMatrix< R, N > ap;
+	multiply( a, p, ap );
+	for ( std::size_t i = 0; i < R; i++ )
+		for ( std::size_t j = i; j < R; j++ )
+		{
+			double s = 0.0;
+			for ( std::size_t k = 0; k < N; k++ )
+				s += ap.m[ i ][ k ] * a.m[ j ][ k ];
+			r.m[ i ][ j ] = s;
+		}
+	r.symmetrize();
+}
+
+/**
+ * Cholesky decomposition of a symmetric positive definite matrix into the lower triangle of l.
+ * @return false if the matrix is not positive definite
+ */
+template< std::size_t N >
+inline bool cholesky( const FixedMatrix< N, N >& a, FixedMatrix< N, N >& l )
+{
+	for ( std::size_t i = 0; i < N; i++ )
+		for ( std::size_t j = 0; j <= i; j++ )
+		{
+			double s = a.m[ i ][ j ];
+			for ( std::size_t k = 0; k < j; k++ )
+				s -= l.m[ i ][ k ] * l.m[ j ][ k ];
+			if ( i == j )
+			{
+				if ( s <= 0.0 )
+					return false;
+				l.m[ i ][ i ] = std::sqrt( s );
+			}
+			else
+				l.m[ i ][ j ] = s / l.m[ j ][ j ];
+		}
+	return true;
+}
+
+/** solves l * l^T * x = b in place for each column of b, given the Cholesky factor l */
+template< std::size_t N, std::size_t C >
+inline void choleskySolve( const FixedMatrix< N, N >& l, FixedMatrix< N, C >& b )
+{
+	for ( std::size_t c = 0; c < C; c++ )
+	{
+		for ( std::size_t i = 0; i < N; i++ )
+		{
+			double s = b.m[ i ][ c ];
+			for ( std::size_t k = 0; k < i; k++ )
+				s -= l.m[ i ][ k ] * b.m[ k ][ c ];
+			b.m[ i ][ c ] = s / l.m[ i ][ i ];
+		}
+		for ( std::size_t i = N; i-- > 0; )
+		{
+			double s = b.m[ i ][ c ];
+			for ( std::size_t k = i + 1; k < N; k++ )
+				s -= l.m[ k ][ i ] * b.m[ k ][ c ];
+			b.m[ i ][ c ] = s / l.m[ i ][ i ];
+		}
+	}
+}
+
+/** prints the matrix in the format of uBLAS */
+template< std::size_t R, std::size_t C >
+std::ostream& operator<<( std::ostream& s, const FixedMatrix< R, C >& a )
+{
+	s << "[" << R << "," << C << "](";
+	for ( std::size_t i = 0; i < R; i++ )
+	{
+		s << ( i ? ",(" : "(" );
+		for ( std::size_t j = 0; j < C; j++ )
+			s << ( j ? "," : "" ) << a.m[ i ][ j ];
+		s << ")";
+	}
+	return s << ")";
+}
+
+} } // namespace Ubitrack::Components
+
+#endif
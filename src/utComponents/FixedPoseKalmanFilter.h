@@ -0,0 +1,742 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#ifndef __UBITRACK_COMPONENTS_FIXEDPOSEKALMANFILTER_H_INCLUDED__
+#define __UBITRACK_COMPONENTS_FIXEDPOSEKALMANFILTER_H_INCLUDED__
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Pose kalman filter with a state size fixed at compile time
+ */
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <boost/static_assert.hpp>
+#include <utMeasurement/Measurement.h>
+#include <utUtil/Exception.h>
+
+#include "FixedMatrix.h"
+#include "FixedQuaternion.h"
+
+namespace Ubitrack { namespace Components {
+
+/**
+ * @ingroup dataflow_components
+ * Extended kalman filter for poses with fixed-size state and covariance.
+ *
+ * The state consists of the position and \c PosOrder derivatives, the orientation quaternion and
+ * \c OriOrder derivatives of the body-frame angular velocity, i.e. the same linear motion model as
+ * Tracking::LinearPoseMotionModel for outside-in tracking. Process noise values are given per derivative
+ * like for the motion model. At least the angular velocity must be part of the state.
+ *
+ * The process noise is white noise of variance posPN[ d ]^2 on position derivative d and oriPN[ d + 1 ]^2
+ * on angular velocity derivative d, integrated over dt into all lower derivatives including the cross-terms,
+ * i.e. the a-fold and b-fold integrals are correlated by dt^(a+b+1) / ( (a+b+1) a! b! ). Angular velocity
+ * noise reaches the quaternion through the jacobian of the orientation update. oriPN[ 0 ]^2 * dt / 4 is added
+ * to each quaternion component, i.e. a rotation error variance of oriPN[ 0 ]^2 * dt.
+ *
+ * Rotation measurements carry no covariance, their variance and that of rotation velocity measurements
+ * are set with \c setMeasurementNoise.
+ *
+ * All matrices live on the stack, no allocations are done after construction. Covariance updates
+ * only compute one triangle of the symmetric results. The innovation covariance is inverted using a
+ * Cholesky decomposition.
+ *
+ * Optionally, the process noise and the covariance of pose measurements are scaled by factors that are
+ * estimated online by covariance matching in the manner of Sage-Husa: the process noise scale from the
+ * normalized innovation squared y^T S^-1 y, whose expectation is the measurement dimension if the predicted
+ * covariance is right, the measurement noise scale from the post-fit residuals e e^T + H P H^T compared to
+ * the measured covariance. The NIS is dimensionless, so position and orientation errors are not mixed. Both are
+ * exponentially weighted averages of the trace ratios and are clamped to configurable bounds.
+ */
+template< std::size_t PosOrder, std::size_t OriOrder >
+class FixedPoseKalmanFilter
+{
+public:
+	/** index of the quaternion in the state */
+	static const std::size_t quatIndex = 3 * ( PosOrder + 1 );
+
+	/** index of the angular velocity in the state */
+	static const std::size_t velIndex = quatIndex + 4;
+
+	/** state size */
+	static const std::size_t N = velIndex + 3 * OriOrder;
+
+	BOOST_STATIC_ASSERT( OriOrder >= 1 );
+
+	typedef FixedMatrix< N, 1 > StateVector;
+	typedef FixedMatrix< N, N > StateMatrix;
+
+	/**
+	 * @param posPN position process noise for each derivative, PosOrder + 1 values
+	 * @param oriPN orientation process noise for each derivative, OriOrder + 1 values
+	 */
+	FixedPoseKalmanFilter( const std::vector< double >& posPN, const std::vector< double >& oriPN )
+		: m_bInitialized( false )
+		, m_time( 0 )
+		, m_rotationNoise( 1e-4 )
+		, m_velocityNoise( 1e-2 )
+		, m_innovation( -1.0 )
+		, m_nis( -1.0 )
+		, m_adaptiveGain( 0.0 )
+		, m_minScale( 1.0 )
+		, m_maxScale( 1.0 )
+		, m_processScale( 1.0 )
+		, m_measurementScale( 1.0 )
+	{
+		if ( posPN.size() != PosOrder + 1 || oriPN.size() != OriOrder + 1 )
+			UBITRACK_THROW( "Wrong number of process noise values for fixed-size kalman filter" );
+
+		for ( std::size_t i = 0; i <= PosOrder; i++ )
+			m_posPN[ i ] = posPN[ i ] * posPN[ i ];
+		for ( std::size_t i = 0; i <= OriOrder; i++ )
+			m_oriPN[ i ] = oriPN[ i ] * oriPN[ i ];
+
+		m_state.setZero();
+		m_covariance.setZero();
+	}
+
+	/**
+	 * sets the noise of measurements that carry no covariance.
+	 * @param rotationNoise standard deviation of rotation measurements in radians
+	 * @param velocityNoise standard deviation of each rotation velocity component in radians per second
+	 */
+	void setMeasurementNoise( double rotationNoise, double velocityNoise )
+	{
+		if ( rotationNoise <= 0.0 || velocityNoise <= 0.0 )
+			UBITRACK_THROW( "Measurement noise must be positive" );
+
+		m_rotationNoise = rotationNoise * rotationNoise;
+		m_velocityNoise = velocityNoise * velocityNoise;
+	}
+
+	/**
+	 * enables the online estimation of process and measurement noise scales.
+	 * @param window number of updates over which the noise statistics are averaged, 0 disables the estimation
+	 * @param minScale lower bound of the scale factors
+	 * @param maxScale upper bound of the scale factors
+	 */
+	void setAdaptiveNoise( std::size_t window, double minScale, double maxScale )
+	{
+		if ( minScale <= 0.0 || minScale > 1.0 || maxScale < 1.0 )
+			UBITRACK_THROW( "Adaptive noise bounds must satisfy 0 < minScale <= 1 <= maxScale" );
+
+		m_adaptiveGain = window ? 1.0 / window : 0.0;
+		m_minScale = minScale;
+		m_maxScale = maxScale;
+		m_processScale = 1.0;
+		m_measurementScale = 1.0;
+	}
+
+	/** integrates a pose measurement */
+	void addPoseMeasurement( const Measurement::ErrorPose& m )
+	{
+		double z[ 7 ];
+		z[ 0 ] = m->translation()( 0 );
+		z[ 1 ] = m->translation()( 1 );
+		z[ 2 ] = m->translation()( 2 );
+		z[ 3 ] = m->rotation().x();
+		z[ 4 ] = m->rotation().y();
+		z[ 5 ] = m->rotation().z();
+		z[ 6 ] = m->rotation().w();
+
+		if ( !m_bInitialized )
+		{
+			initialize( m.time(), z, true );
+			initializeCovariance( m->covariance(), z );
+			return;
+		}
+
+		timeUpdate( m.time() );
+		alignQuaternion( z + 3 );
+
+		// measurement covariance of the additive 7-vector
+		FixedMatrix< 7, 6 > jacobian( FixedMatrix< 7, 6 >::zeros() );
+		errorJacobian( z + 3, jacobian );
+		FixedMatrix< 6, 6 > cov6;
+		for ( std::size_t i = 0; i < 6; i++ )
+			for ( std::size_t j = 0; j < 6; j++ )
+				cov6( i, j ) = m->covariance()( i, j );
+		FixedMatrix< 7, 7 > r;
+		similarity( jacobian, cov6, r );
+		for ( std::size_t i = 0; i < 7; i++ )
+			for ( std::size_t j = 0; j < 7; j++ )
+				r( i, j ) *= m_measurementScale;
+		for ( std::size_t i = 3; i < 7; i++ )
+			r( i, i ) += 1e-12;
+
+		FixedMatrix< 7, N > h( FixedMatrix< 7, N >::zeros() );
+		FixedMatrix< 7, 1 > innovation;
+		for ( std::size_t i = 0; i < 3; i++ )
+		{
+			h( i, i ) = 1.0;
+			innovation[ i ] = z[ i ] - m_state[ i ];
+		}
+		for ( std::size_t i = 0; i < 4; i++ )
+		{
+			h( 3 + i, quatIndex + i ) = 1.0;
+			innovation[ 3 + i ] = z[ 3 + i ] - m_state[ quatIndex + i ];
+		}
+
+		measurementUpdate( h, innovation, r, true );
+	}
+
+	/** integrates a rotation measurement */
+	void addRotationMeasurement( const Measurement::Rotation& m )
+	{
+		double z[ 7 ];
+		z[ 3 ] = m->x();
+		z[ 4 ] = m->y();
+		z[ 5 ] = m->z();
+		z[ 6 ] = m->w();
+
+		if ( !m_bInitialized )
+		{
+			initialize( m.time(), z, false );
+			return;
+		}
+
+		timeUpdate( m.time() );
+		alignQuaternion( z + 3 );
+
+		FixedMatrix< 4, 3 > jacobian;
+		FixedMatrix< 4, 4 > l;
+		quaternionLeftMatrix( z + 3, l );
+		for ( std::size_t i = 0; i < 4; i++ )
+			for ( std::size_t j = 0; j < 3; j++ )
+				jacobian( i, j ) = l( i, j );
+		FixedMatrix< 3, 3 > cov3( FixedMatrix< 3, 3 >::identity() );
+		for ( std::size_t i = 0; i < 3; i++ )
+			cov3( i, i ) = m_rotationNoise;
+		FixedMatrix< 4, 4 > r;
+		similarity( jacobian, cov3, r );
+		for ( std::size_t i = 0; i < 4; i++ )
+			r( i, i ) += 1e-12;
+
+		FixedMatrix< 4, N > h( FixedMatrix< 4, N >::zeros() );
+		FixedMatrix< 4, 1 > innovation;
+		for ( std::size_t i = 0; i < 4; i++ )
+		{
+			h( i, quatIndex + i ) = 1.0;
+			innovation[ i ] = z[ 3 + i ] - m_state[ quatIndex + i ];
+		}
+
+		measurementUpdate( h, innovation, r );
+	}
+
+	/** integrates a body-frame rotation velocity measurement */
+	void addRotationVelocityMeasurement( const Measurement::RotationVelocity& m )
+	{
+		if ( !m_bInitialized )
+			return;
+
+		timeUpdate( m.time() );
+
+		double z[ 3 ] = { ( *m )( 0 ), ( *m )( 1 ), ( *m )( 2 ) };
+		velocityUpdate( z );
+	}
+
+	/** integrates a rotation velocity measurement of the inverse pose */
+	void addInverseRotationVelocityMeasurement( const Measurement::RotationVelocity& m )
+	{
+		if ( !m_bInitialized )
+			return;
+
+		timeUpdate( m.time() );
+
+		// the velocity of the inverse is -R(q) * omega
+		FixedMatrix< 3, 3 > rot;
+		quaternionRotationMatrix( &m_state.m[ quatIndex ][ 0 ], rot );
+		double z[ 3 ];
+		for ( std::size_t i = 0; i < 3; i++ )
+			z[ i ] = -( rot( 0, i ) * ( *m )( 0 ) + rot( 1, i ) * ( *m )( 1 ) + rot( 2, i ) * ( *m )( 2 ) );
+		velocityUpdate( z );
+	}
+
+	/** predicts the pose at time t without changing the filter state */
+	Measurement::ErrorPose predictPose( Measurement::Timestamp t ) const
+	{
+		if ( !m_bInitialized )
+			UBITRACK_THROW( "Kalman filter has not been initialized" );
+
+		StateVector x( m_state );
+		StateMatrix p( m_covariance );
+		if ( t > m_time )
+			predict( x, p, ( t - m_time ) * 1e-9 );
+
+		// convert the additive quaternion covariance to the rotation error vector
+		FixedMatrix< 6, N > jacobian( FixedMatrix< 6, N >::zeros() );
+		FixedMatrix< 4, 4 > l;
+		quaternionLeftMatrix( &x.m[ quatIndex ][ 0 ], l );
+		for ( std::size_t i = 0; i < 3; i++ )
+		{
+			jacobian( i, i ) = 1.0;
+			for ( std::size_t j = 0; j < 4; j++ )
+				jacobian( 3 + i, quatIndex + j ) = l( j, i );
+		}
+		FixedMatrix< 6, 6 > cov6;
+		similarity( jacobian, p, cov6 );
+
+		Math::Matrix< double, 6, 6 > covariance;
+		for ( std::size_t i = 0; i < 6; i++ )
+			for ( std::size_t j = 0; j < 6; j++ )
+				covariance( i, j ) = cov6( i, j );
+
+		Math::Pose pose( Math::Quaternion( x[ quatIndex ], x[ quatIndex + 1 ], x[ quatIndex + 2 ], x[ quatIndex + 3 ] ),
+			Math::Vector< double, 3 >( x[ 0 ], x[ 1 ], x[ 2 ] ) );
+		return Measurement::ErrorPose( t, Math::ErrorPose( pose, covariance ) );
+	}
+
+	const StateVector& getState() const
+	{ return m_state; }
+
+	const StateMatrix& getCovariance() const
+	{ return m_covariance; }
+
+	/** norm of the innovation of the last measurement update */
+	double getInnovation() const
+	{ return m_innovation; }
+
+	/** normalized innovation squared of the last measurement update, negative if the update failed */
+	double getNis() const
+	{ return m_nis; }
+
+	/** current factor of the process noise, 1 if not adaptive */
+	double getProcessNoiseScale() const
+	{ return m_processScale; }
+
+	/** current factor of the pose measurement covariances, 1 if not adaptive */
+	double getMeasurementNoiseScale() const
+	{ return m_measurementScale; }
+
+protected:
+	/** initializes the state from a first measurement, z contains position and quaternion */
+	void initialize( Measurement::Timestamp t, const double* z, bool bPosition )
+	{
+		m_state.setZero();
+		m_covariance.setZero();
+		for ( std::size_t i = 0; i < 3; i++ )
+			m_state[ i ] = bPosition ? z[ i ] : 0.0;
+		for ( std::size_t i = 0; i < 4; i++ )
+			m_state[ quatIndex + i ] = z[ 3 + i ];
+
+		// large uncertainty for everything that was not measured
+		for ( std::size_t i = 0; i < N; i++ )
+			m_covariance( i, i ) = i < quatIndex ? 1e2 : 1.0;
+		for ( std::size_t i = quatIndex; i < velIndex; i++ )
+			m_covariance( i, i ) = m_rotationNoise;
+
+		m_time = t;
+		m_bInitialized = true;
+	}
+
+	/** copies the covariance of the first pose measurement into the state covariance */
+	template< class CovarianceType >
+	void initializeCovariance( const CovarianceType& cov, const double* z )
+	{
+		FixedMatrix< 7, 6 > jacobian( FixedMatrix< 7, 6 >::zeros() );
+		errorJacobian( z + 3, jacobian );
+		FixedMatrix< 6, 6 > cov6;
+		for ( std::size_t i = 0; i < 6; i++ )
+			for ( std::size_t j = 0; j < 6; j++ )
+				cov6( i, j ) = cov( i, j );
+		FixedMatrix< 7, 7 > r;
+		similarity( jacobian, cov6, r );
+
+		for ( std::size_t i = 0; i < 7; i++ )
+			for ( std::size_t j = 0; j < 7; j++ )
+				m_covariance( i < 3 ? i : quatIndex + i - 3, j < 3 ? j : quatIndex + j - 3 ) = r( i, j );
+	}
+
+	/**
+	 * jacobian of the additive position/quaternion 7-vector w.r.t. the position/rotation error 6-vector.
+	 * The rotation error is the vector part of a right-multiplied error quaternion, as for Math::ErrorPose.
+	 */
+	static void errorJacobian( const double* q, FixedMatrix< 7, 6 >& jacobian )
+	{
+		FixedMatrix< 4, 4 > l;
+		quaternionLeftMatrix( q, l );
+		for ( std::size_t i = 0; i < 3; i++ )
+			jacobian( i, i ) = 1.0;
+		for ( std::size_t i = 0; i < 4; i++ )
+			for ( std::size_t j = 0; j < 3; j++ )
+				jacobian( 3 + i, 3 + j ) = l( i, j );
+	}
+
+	/** flips the sign of a measured quaternion if it points away from the state */
+	void alignQuaternion( double* q ) const
+	{
+		double dot = 0.0;
+		for ( std::size_t i = 0; i < 4; i++ )
+			dot += q[ i ] * m_state[ quatIndex + i ];
+		if ( dot < 0 )
+			for ( std::size_t i = 0; i < 4; i++ )
+				q[ i ] = -q[ i ];
+	}
+
+	/** advances the filter to time t. Measurements older than the state are integrated at the current time. */
+	void timeUpdate( Measurement::Timestamp t )
+	{
+		if ( t > m_time )
+		{
+			predict( m_state, m_covariance, ( t - m_time ) * 1e-9 );
+			m_time = t;
+		}
+	}
+
+	/** time update of state x and covariance p by dt seconds */
+	void predict( StateVector& x, StateMatrix& p, double dt ) const
+	{
+		// state transition jacobian
+		StateMatrix f( StateMatrix::identity() );
+
+		// position: taylor series of the derivatives
+		for ( std::size_t d = 0; d <= PosOrder; d++ )
+		{
+			double factor = 1.0;
+			for ( std::size_t k = d + 1; k <= PosOrder; k++ )
+			{
+				factor *= dt / ( k - d );
+				for ( std::size_t i = 0; i < 3; i++ )
+					f( 3 * d + i, 3 * k + i ) = factor;
+			}
+		}
+
+		// angular velocity derivatives
+		for ( std::size_t d = 0; d < OriOrder; d++ )
+		{
+			double factor = 1.0;
+			for ( std::size_t k = d + 1; k < OriOrder; k++ )
+			{
+				factor *= dt / ( k - d );
+				for ( std::size_t i = 0; i < 3; i++ )
+					f( velIndex + 3 * d + i, velIndex + 3 * k + i ) = factor;
+			}
+		}
+
+		// orientation: q' = q * exp( omega * dt / 2 ), using the mean angular velocity over the interval
+		double omega[ 3 ];
+		for ( std::size_t i = 0; i < 3; i++ )
+		{
+			omega[ i ] = x[ velIndex + i ];
+			double factor = 1.0;
+			for ( std::size_t k = 1; k < OriOrder; k++ )
+			{
+				factor *= dt / ( k + 1 );
+				omega[ i ] += factor * x[ velIndex + 3 * k + i ];
+			}
+		}
+		double angle = 0.5 * dt * std::sqrt( omega[ 0 ] * omega[ 0 ] + omega[ 1 ] * omega[ 1 ] + omega[ 2 ] * omega[ 2 ] );
+		double s = angle > 1e-12 ? std::sin( angle ) / angle * 0.5 * dt : 0.5 * dt;
+		double dq[ 4 ] = { omega[ 0 ] * s, omega[ 1 ] * s, omega[ 2 ] * s, std::cos( angle ) };
+
+		FixedMatrix< 4, 4 > qr;
+		quaternionRightMatrix( dq, qr );
+		FixedMatrix< 4, 4 > ql;
+		quaternionLeftMatrix( &x.m[ quatIndex ][ 0 ], ql );
+		for ( std::size_t i = 0; i < 4; i++ )
+		{
+			for ( std::size_t j = 0; j < 4; j++ )
+				f( quatIndex + i, quatIndex + j ) = qr( i, j );
+
+			// small angle approximation of the derivative w.r.t. the angular velocity derivatives
+			double factor = 0.5 * dt;
+			for ( std::size_t k = 0; k < OriOrder; k++ )
+			{
+				for ( std::size_t j = 0; j < 3; j++ )
+					f( quatIndex + i, velIndex + 3 * k + j ) = factor * ql( i, j );
+				factor *= dt / ( k + 2 );
+			}
+		}
+
+		// state: x' = F x for the linear parts
+		StateVector xNew;
+		multiply( f, x, xNew );
+		double q[ 4 ];
+		for ( std::size_t i = 0; i < 4; i++ )
+			q[ i ] = x[ quatIndex + i ];
+		for ( std::size_t i = 0; i < 4; i++ )
+			xNew[ quatIndex + i ] = qr( i, 0 ) * q[ 0 ] + qr( i, 1 ) * q[ 1 ] + qr( i, 2 ) * q[ 2 ] + qr( i, 3 ) * q[ 3 ];
+		x = xNew;
+		normalizeQuaternion( x );
+
+		// covariance: P' = F P F^T + Q
+		StateMatrix pNew;
+		similarity( f, p, pNew );
+		addProcessNoise( pNew, ql, dt );
+		p = pNew;
+	}
+
+	/**
+	 * covariance of the a-fold and the b-fold integral of unit white noise over dt, i.e.
+	 * the integral of s^a / a! * s^b / b! from 0 to dt
+	 */
+	static double integratedNoise( std::size_t a, std::size_t b, double dt )
+	{
+		double v = 1.0 / ( a + b + 1 );
+		for ( std::size_t k = 0; k < a + b + 1; k++ )
+			v *= dt;
+		for ( std::size_t k = 2; k <= a; k++ )
+			v /= k;
+		for ( std::size_t k = 2; k <= b; k++ )
+			v /= k;
+		return v;
+	}
+
+	/**
+	 * adds the discretized process noise Q to p. The noise of each derivative is integrated into all lower
+	 * derivatives, including the correlations between them. Angular velocity noise reaches the quaternion
+	 * through the same small angle jacobian 0.5 * ql as in F.
+	 */
+	void addProcessNoise( StateMatrix& p, const FixedMatrix< 4, 4 >& ql, double dt ) const
+	{
+		// position: noise on derivative d, integrated a and b times
+		for ( std::size_t d = 0; d <= PosOrder; d++ )
+			for ( std::size_t a = 0; a <= d; a++ )
+				for ( std::size_t b = 0; b <= d; b++ )
+				{
+					double q = m_processScale * m_posPN[ d ] * integratedNoise( a, b, dt );
+					for ( std::size_t i = 0; i < 3; i++ )
+						p( 3 * ( d - a ) + i, 3 * ( d - b ) + i ) += q;
+				}
+
+		// quaternion noise, a rotation error variance of oriPN[ 0 ] * dt
+		for ( std::size_t i = quatIndex; i < velIndex; i++ )
+			p( i, i ) += 0.25 * m_processScale * m_oriPN[ 0 ] * dt;
+
+		// noise on angular velocity derivative d, integrated d + 1 times into the quaternion
+		for ( std::size_t d = 0; d < OriOrder; d++ )
+		{
+			for ( std::size_t a = 0; a <= d; a++ )
+				for ( std::size_t b = 0; b <= d; b++ )
+				{
+					double q = m_processScale * m_oriPN[ d + 1 ] * integratedNoise( a, b, dt );
+					for ( std::size_t i = 0; i < 3; i++ )
+						p( velIndex + 3 * ( d - a ) + i, velIndex + 3 * ( d - b ) + i ) += q;
+				}
+
+			for ( std::size_t b = 0; b <= d; b++ )
+			{
+				double q = 0.5 * m_processScale * m_oriPN[ d + 1 ] * integratedNoise( d + 1, b, dt );
+				for ( std::size_t i = 0; i < 4; i++ )
+					for ( std::size_t j = 0; j < 3; j++ )
+					{
+						p( quatIndex + i, velIndex + 3 * ( d - b ) + j ) += q * ql( i, j );
+						p( velIndex + 3 * ( d - b ) + j, quatIndex + i ) += q * ql( i, j );
+					}
+			}
+
+			double q = 0.25 * m_processScale * m_oriPN[ d + 1 ] * integratedNoise( d + 1, d + 1, dt );
+			for ( std::size_t i = 0; i < 4; i++ )
+				for ( std::size_t j = 0; j < 4; j++ )
+					p( quatIndex + i, quatIndex + j ) += q *
+						( ql( i, 0 ) * ql( j, 0 ) + ql( i, 1 ) * ql( j, 1 ) + ql( i, 2 ) * ql( j, 2 ) );
+		}
+	}
+
+	/** moves a noise scale towards a new sample, within the bounds */
+	void adaptScale( double& scale, double sample ) const
+	{
+		scale += m_adaptiveGain * ( sample - scale );
+		scale = std::min( m_maxScale, std::max( m_minScale, scale ) );
+	}
+
+	/**
+	 * linear measurement update with innovation covariance S = H P H^T + R.
+	 * If bScaledR is set, r has been multiplied with the measurement noise scale, which is then adapted.
+	 */
+	template< std::size_t M >
+	void measurementUpdate( const FixedMatrix< M, N >& h, const FixedMatrix< M, 1 >& innovation, const FixedMatrix< M, M >& r,
+		bool bScaledR = false )
+	{
+		FixedMatrix< M, M > s;
+		similarity( h, m_covariance, s );
+		for ( std::size_t i = 0; i < M; i++ )
+			for ( std::size_t j = 0; j < M; j++ )
+				s( i, j ) += r( i, j );
+
+		m_innovation = 0.0;
+		for ( std::size_t i = 0; i < M; i++ )
+			m_innovation += innovation[ i ] * innovation[ i ];
+		m_innovation = std::sqrt( m_innovation );
+
+		FixedMatrix< M, M > l;
+		if ( !cholesky( s, l ) )
+		{
+			m_nis = -1.0;
+			return;
+		}
+
+		// NIS = y^T S^-1 y = |L^-1 y|^2
+		double w[ M ];
+		m_nis = 0.0;
+		for ( std::size_t i = 0; i < M; i++ )
+		{
+			w[ i ] = innovation[ i ];
+			for ( std::size_t k = 0; k < i; k++ )
+				w[ i ] -= l( i, k ) * w[ k ];
+			w[ i ] /= l( i, i );
+			m_nis += w[ i ] * w[ i ];
+		}
+
+		// K^T = S^-1 H P
+		FixedMatrix< M, N > hp;
+		multiply( h, m_covariance, hp );
+		FixedMatrix< M, N > kt( hp );
+		choleskySolve( l, kt );
+
+		// x += K * innovation
+		StateVector dx( StateVector::zeros() );
+		for ( std::size_t i = 0; i < N; i++ )
+		{
+			for ( std::size_t k = 0; k < M; k++ )
+				dx[ i ] += kt( k, i ) * innovation[ k ];
+			m_state[ i ] += dx[ i ];
+		}
+
+		// P -= K S K^T = ( H P )^T S^-1 ( H P ), upper triangle only
+		for ( std::size_t i = 0; i < N; i++ )
+			for ( std::size_t j = i; j < N; j++ )
+			{
+				double sum = 0.0;
+				for ( std::size_t k = 0; k < M; k++ )
+					sum += hp( k, i ) * kt( k, j );
+				m_covariance( i, j ) -= sum;
+			}
+		m_covariance.symmetrize();
+
+		normalizeQuaternion( m_state );
+
+		if ( m_adaptiveGain > 0.0 )
+			adaptNoise( h, innovation, r, dx, bScaledR );
+	}
+
+	/** covariance matching of the process noise and, if bScaledR is set, of the measurement noise */
+	template< std::size_t M >
+	void adaptNoise( const FixedMatrix< M, N >& h, const FixedMatrix< M, 1 >& innovation, const FixedMatrix< M, M >& r,
+		const StateVector& dx, bool bScaledR )
+	{
+		// E[ y^T S^-1 y ] is the number of degrees of freedom of the measurement if the predicted covariance
+		// is right. Measurements with a quaternion have one less than their size, as it has unit length.
+		// Q is scaled by the ratio, which also absorbs errors of R for measurements whose noise is not adapted.
+		const double dof( M == 3 ? 3.0 : M - 1.0 );
+		adaptScale( m_processScale, m_processScale * m_nis / dof );
+
+		if ( !bScaledR )
+			return;
+
+		// E[ e e^T + H P H^T ] = R with the post-fit residual e = y - H dx
+		double trR = 0.0;
+		double e2 = 0.0;
+		for ( std::size_t i = 0; i < M; i++ )
+		{
+			trR += r( i, i );
+			double e = innovation[ i ];
+			for ( std::size_t j = 0; j < N; j++ )
+				e -= h( i, j ) * dx[ j ];
+			e2 += e * e;
+		}
+		FixedMatrix< M, M > hph;
+		similarity( h, m_covariance, hph );
+		for ( std::size_t i = 0; i < M; i++ )
+			e2 += hph( i, i );
+
+		if ( trR > 0.0 )
+			adaptScale( m_measurementScale, m_measurementScale * e2 / trR );
+	}
+
+	/** update of the angular velocity with a body-frame measurement */
+	void velocityUpdate( const double* z )
+	{
+		FixedMatrix< 3, N > h( FixedMatrix< 3, N >::zeros() );
+		FixedMatrix< 3, 1 > innovation;
+		FixedMatrix< 3, 3 > r( FixedMatrix< 3, 3 >::zeros() );
+		for ( std::size_t i = 0; i < 3; i++ )
+		{
+			h( i, velIndex + i ) = 1.0;
+			innovation[ i ] = z[ i ] - m_state[ velIndex + i ];
+			r( i, i ) = m_velocityNoise;
+		}
+
+		measurementUpdate( h, innovation, r );
+	}
+
+	static void normalizeQuaternion( StateVector& x )
+	{
+		double n = std::sqrt( x[ quatIndex ] * x[ quatIndex ] + x[ quatIndex + 1 ] * x[ quatIndex + 1 ] +
+			x[ quatIndex + 2 ] * x[ quatIndex + 2 ] + x[ quatIndex + 3 ] * x[ quatIndex + 3 ] );
+		if ( n > 0 )
+			for ( std::size_t i = quatIndex; i < velIndex; i++ )
+				x[ i ] /= n;
+	}
+
+	/** has a first measurement been received? */
+	bool m_bInitialized;
+
+	/** time of the state */
+	Measurement::Timestamp m_time;
+
+	/** squared process noise per derivative */
+	double m_posPN[ PosOrder + 1 ];
+	double m_oriPN[ OriOrder + 1 ];
+
+	/** variance of rotation measurements without covariance */
+	double m_rotationNoise;
+
+	/** variance of rotation velocity measurements */
+	double m_velocityNoise;
+
+	/** statistics of the last measurement update */
+	double m_innovation;
+	double m_nis;
+
+	/** weight of a new sample in the noise scale estimates, 0 if not adaptive */
+	double m_adaptiveGain;
+
+	/** bounds of the noise scales */
+	double m_minScale;
+	double m_maxScale;
+
+	/** current factors of the process noise and the pose measurement covariances */
+	double m_processScale;
+	double m_measurementScale;
+
+	StateVector m_state;
+	StateMatrix m_covariance;
+};
+
+
+/** statistics of the last update, see PoseFilter */
+template< std::size_t PosOrder, std::size_t OriOrder >
+bool filterUpdateStatistics( const FixedPoseKalmanFilter< PosOrder, OriOrder >& f, double& innovation, double& nis )
+{
+	innovation = f.getInnovation();
+	nis = f.getNis();
+	return true;
+}
+
+} } // namespace Ubitrack::Components
+
+#endif
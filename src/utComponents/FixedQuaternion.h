@@ -0,0 +1,179 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#ifndef __UBITRACK_COMPONENTS_FIXEDQUATERNION_H_INCLUDED__
+#define __UBITRACK_COMPONENTS_FIXEDQUATERNION_H_INCLUDED__
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Quaternion operations on plain arrays for the fixed-size filters
+ */
+
+#include <cmath>
+
+#include "FixedMatrix.h"
+
+namespace Ubitrack { namespace Components {
+
+/** matrix of the quaternion product q * p as a function of p, components in the order x, y, z, w */
+inline void quaternionLeftMatrix( const double* q, FixedMatrix< 4, 4 >& l )
+{
+	l( 0, 0 ) =  q[ 3 ]; l( 0, 1 ) = -q[ 2 ]; l( 0, 2 ) =  q[ 1 ]; l( 0, 3 ) = q[ 0 ];
+	l( 1, 0 ) =  q[ 2 ]; l( 1, 1 ) =  q[ 3 ]; l( 1, 2 ) = -q[ 0 ]; l( 1, 3 ) = q[ 1 ];
+	l( 2, 0 ) = -q[ 1 ]; l( 2, 1 ) =  q[ 0 ]; l( 2, 2 ) =  q[ 3 ]; l( 2, 3 ) = q[ 2 ];
+	l( 3, 0 ) = -q[ 0 ]; l( 3, 1 ) = -q[ 1 ]; l( 3, 2 ) = -q[ 2 ]; l( 3, 3 ) = q[ 3 ];
+}
+
+/** matrix of the quaternion product q * p as a function of q, components in the order x, y, z, w */
+inline void quaternionRightMatrix( const double* p, FixedMatrix< 4, 4 >& r )
+{
+	r( 0, 0 ) =  p[ 3 ]; r( 0, 1 ) =  p[ 2 ]; r( 0, 2 ) = -p[ 1 ]; r( 0, 3 ) = p[ 0 ];
+	r( 1, 0 ) = -p[ 2 ]; r( 1, 1 ) =  p[ 3 ]; r( 1, 2 ) =  p[ 0 ]; r( 1, 3 ) = p[ 1 ];
+	r( 2, 0 ) =  p[ 1 ]; r( 2, 1 ) = -p[ 0 ]; r( 2, 2 ) =  p[ 3 ]; r( 2, 3 ) = p[ 2 ];
+	r( 3, 0 ) = -p[ 0 ]; r( 3, 1 ) = -p[ 1 ]; r( 3, 2 ) = -p[ 2 ]; r( 3, 3 ) = p[ 3 ];
+}
+
+/** rotation matrix of a unit quaternion, components in the order x, y, z, w */
+inline void quaternionRotationMatrix( const double* q, FixedMatrix< 3, 3 >& r )
+{
+	const double x = q[ 0 ], y = q[ 1 ], z = q[ 2 ], w = q[ 3 ];
+	r( 0, 0 ) = 1 - 2 * ( y * y + z * z ); r( 0, 1 ) = 2 * ( x * y - w * z ); r( 0, 2 ) = 2 * ( x * z + w * y );
+	r( 1, 0 ) = 2 * ( x * y + w * z ); r( 1, 1 ) = 1 - 2 * ( x * x + z * z ); r( 1, 2 ) = 2 * ( y * z - w * x );
+	r( 2, 0 ) = 2 * ( x * z - w * y ); r( 2, 1 ) = 2 * ( y * z + w * x ); r( 2, 2 ) = 1 - 2 * ( x * x + y * y );
+}
+
+/** product of two quaternions, components in the order x, y, z, w */
+inline void quaternionMultiply( const double* a, const double* b, double* r )
+{
+	double x = a[ 3 ] * b[ 0 ] + a[ 0 ] * b[ 3 ] + a[ 1 ] * b[ 2 ] - a[ 2 ] * b[ 1 ];
+	double y = a[ 3 ] * b[ 1 ] - a[ 0 ] * b[ 2 ] + a[ 1 ] * b[ 3 ] + a[ 2 ] * b[ 0 ];
+	double z = a[ 3 ] * b[ 2 ] + a[ 0 ] * b[ 1 ] - a[ 1 ] * b[ 0 ] + a[ 2 ] * b[ 3 ];
+	double w = a[ 3 ] * b[ 3 ] - a[ 0 ] * b[ 0 ] - a[ 1 ] * b[ 1 ] - a[ 2 ] * b[ 2 ];
+	r[ 0 ] = x; r[ 1 ] = y; r[ 2 ] = z; r[ 3 ] = w;
+}
+
+/** unit quaternion of a rotation vector */
+inline void quaternionExp( const double* v, double* q )
+{
+	double angle = std::sqrt( v[ 0 ] * v[ 0 ] + v[ 1 ] * v[ 1 ] + v[ 2 ] * v[ 2 ] );
+	double s = angle > 1e-12 ? std::sin( 0.5 * angle ) / angle : 0.5;
+	q[ 0 ] = v[ 0 ] * s;
+	q[ 1 ] = v[ 1 ] * s;
+	q[ 2 ] = v[ 2 ] * s;
+	q[ 3 ] = std::cos( 0.5 * angle );
+}
+
+/**
+ * computes the eigenvector of the largest eigenvalue of a symmetric 4x4 matrix with cyclic jacobi rotations.
+ * The matrix is destroyed.
+ */
+inline void largestEigenvector( double a[ 4 ][ 4 ], double* v )
+{
+	double e[ 4 ][ 4 ] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 } };
+
+	for ( int sweep = 0; sweep < 50; sweep++ )
+	{
+		double off( 0.0 );
+		for ( std::size_t p = 0; p < 4; p++ )
+			for ( std::size_t q = p + 1; q < 4; q++ )
+				off += a[ p ][ q ] * a[ p ][ q ];
+		if ( off < 1e-30 )
+			break;
+
+		for ( std::size_t p = 0; p < 4; p++ )
+			for ( std::size_t q = p + 1; q < 4; q++ )
+			{
+				if ( a[ p ][ q ] == 0.0 )
+					continue;
+
+				double theta( ( a[ q ][ q ] - a[ p ][ p ] ) / ( 2.0 * a[ p ][ q ] ) );
+				double t( ( theta >= 0.0 ? 1.0 : -1.0 ) / ( std::fabs( theta ) + std::sqrt( theta * theta + 1.0 ) ) );
+				double c( 1.0 / std::sqrt( t * t + 1.0 ) );
+				double s( t * c );
+
+				for ( std::size_t k = 0; k < 4; k++ )
+				{
+					double akp( a[ k ][ p ] );
+					double akq( a[ k ][ q ] );
+					a[ k ][ p ] = c * akp - s * akq;
+					a[ k ][ q ] = s * akp + c * akq;
+				}
+				for ( std::size_t k = 0; k < 4; k++ )
+				{
+					double apk( a[ p ][ k ] );
+					double aqk( a[ q ][ k ] );
+					a[ p ][ k ] = c * apk - s * aqk;
+					a[ q ][ k ] = s * apk + c * aqk;
+				}
+				for ( std::size_t k = 0; k < 4; k++ )
+				{
+					double ekp( e[ k ][ p ] );
+					double ekq( e[ k ][ q ] );
+					e[ k ][ p ] = c * ekp - s * ekq;
+					e[ k ][ q ] = s * ekp + c * ekq;
+				}
+			}
+	}
+
+	std::size_t best( 0 );
+	for ( std::size_t i = 1; i < 4; i++ )
+		if ( a[ i ][ i ] > a[ best ][ best ] )
+			best = i;
+	for ( std::size_t i = 0; i < 4; i++ )
+		v[ i ] = e[ i ][ best ];
+}
+
+/**
+ * mean rotation of quaternion samples from their arithmetic mean and covariance.
+ * The result is the eigenvector of the largest eigenvalue of the scatter matrix E[ q q^T ] = covariance + mean mean^T
+ * (Markley et al., "Averaging Quaternions"), which minimizes the mean squared chordal distance to the samples,
+ * in the hemisphere of the arithmetic mean. The covariance is changed to be taken around the result.
+ */
+inline void quaternionScatterMean( const double* mean, double covariance[ 4 ][ 4 ], double* q )
+{
+	double scatter[ 4 ][ 4 ];
+	for ( std::size_t i = 0; i < 4; i++ )
+		for ( std::size_t j = 0; j < 4; j++ )
+			scatter[ i ][ j ] = covariance[ i ][ j ] + mean[ i ] * mean[ j ];
+	largestEigenvector( scatter, q );
+
+	double dot( 0.0 );
+	for ( std::size_t i = 0; i < 4; i++ )
+		dot += q[ i ] * mean[ i ];
+	if ( dot < 0.0 )
+		for ( std::size_t i = 0; i < 4; i++ )
+			q[ i ] = -q[ i ];
+
+	// E[ ( x - q )( x - q )^T ] = covariance + ( mean - q )( mean - q )^T
+	double d[ 4 ];
+	for ( std::size_t i = 0; i < 4; i++ )
+		d[ i ] = mean[ i ] - q[ i ];
+	for ( std::size_t i = 0; i < 4; i++ )
+		for ( std::size_t j = 0; j < 4; j++ )
+			covariance[ i ][ j ] += d[ i ] * d[ j ];
+}
+
+} } // namespace Ubitrack::Components
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#ifndef __UBITRACK_COMPONENTS_GYROPREINTEGRATION_H_INCLUDED__
+#define __UBITRACK_COMPONENTS_GYROPREINTEGRATION_H_INCLUDED__
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Preintegration of gyroscope measurements
+ */
+
+#include "FixedMatrix.h"
+#include "FixedQuaternion.h"
+
+namespace Ubitrack { namespace Components {
+
+/**
+ * @ingroup dataflow_components
+ * Preintegrated gyroscope measurements between two filter steps.
+ *
+ * Keeps the delta rotation, the covariance of its rotation error and the jacobian of the rotation
+ * error w.r.t. the gyro bias, all in the body frame at the start of the interval. Each sample only
+ * costs a few 3x3 operations.
+ */
+class GyroPreintegration
+{
+public:
+	GyroPreintegration()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		m_rotation[ 0 ] = m_rotation[ 1 ] = m_rotation[ 2 ] = 0.0;
+		m_rotation[ 3 ] = 1.0;
+		m_covariance.setZero();
+		m_biasJacobian.setZero();
+	}
+
+	/**
+	 * integrates a bias-corrected angular velocity over dt seconds.
+	 * @param variance continuous-time variance of the gyro noise in rad^2/s
+	 */
+	void integrate( const double* omega, double dt, double variance )
+	{
+		double v[ 3 ] = { omega[ 0 ] * dt, omega[ 1 ] * dt, omega[ 2 ] * dt };
+		double dq[ 4 ];
+		quaternionExp( v, dq );
+		quaternionMultiply( m_rotation, dq, m_rotation );
+
+		// the errors are transformed into the frame at the end of the step
+		FixedMatrix< 3, 3 > r;
+		quaternionRotationMatrix( dq, r );
+		FixedMatrix< 3, 3 > a;
+		for ( std::size_t i = 0; i < 3; i++ )
+			for ( std::size_t j = 0; j < 3; j++ )
+				a( i, j ) = r( j, i );
+
+		FixedMatrix< 3, 3 > cov;
+		similarity( a, m_covariance, cov );
+		for ( std::size_t i = 0; i < 3; i++ )
+			cov( i, i ) += variance * dt;
+		m_covariance = cov;
+
+		FixedMatrix< 3, 3 > jacobian;
+		multiply( a, m_biasJacobian, jacobian );
+		for ( std::size_t i = 0; i < 3; i++ )
+			jacobian( i, i ) -= dt;
+		m_biasJacobian = jacobian;
+	}
+
+	/** delta rotation as quaternion */
+	const double* rotation() const
+	{ return m_rotation; }
+
+	const FixedMatrix< 3, 3 >& covariance() const
+	{ return m_covariance; }
+
+	const FixedMatrix< 3, 3 >& biasJacobian() const
+	{ return m_biasJacobian; }
+
+protected:
+	double m_rotation[ 4 ];
+	FixedMatrix< 3, 3 > m_covariance;
+	FixedMatrix< 3, 3 > m_biasJacobian;
+};
+
+} } // namespace Ubitrack::Components
+
+#endif
@@ -35,9 +35,17 @@
 #include <utDataflow/ComponentFactory.h>
 #include <utMeasurement/Measurement.h>
 #include <utMath/Vector.h>
+#include <utUtil/Exception.h>
 
 #include <utCalibration/HandEyeCalibration.h>
 
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <boost/scoped_ptr.hpp>
+
+#include "ParallelRansac.h"
+
 // get a logger
 static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Components.HandEyeCalibration" ) );
 static log4cpp::Category& eventLogger( log4cpp::Category::getInstance( "Ubitrack.Events.Components.HandEyeCalibration" ) );
@@ -100,8 +108,289 @@ protected:
 };
 
 
+/**
+ * hand-eye calibration from motion pairs for ParallelRansac.
+ *
+ * A motion pair consists of two poses. A hypothesis X, the pose of the eye in the hand frame, is consistent
+ * with a motion pair if the pose of the object in the robot frame, H_i * X * O_i, is the same for both poses.
+ * The error is the larger of the translation and rotation differences, each divided by its threshold, so
+ * inliers have errors below 1.
+ */
+class HandEyeProblem
+{
+public:
+	typedef Math::Pose result_type;
+
+	HandEyeProblem( const std::vector< Math::Pose >& hand, const std::vector< Math::Pose >& eye,
+		const std::vector< std::size_t >& pairs, double threshold, double angleThreshold )
+		: m_hand( hand )
+		, m_eye( eye )
+		, m_pairs( pairs )
+		, m_threshold( threshold )
+		, m_angleThreshold( angleThreshold )
+	{}
+
+	/** number of motion pairs, pair k consists of the poses pairs[ k ] and pairs[ k + 1 ] */
+	std::size_t size() const
+	{ return m_pairs.size() - 1; }
+
+	bool estimate( Math::Pose& result, const std::vector< std::size_t >& indices ) const
+	{
+		// poses of all motion pairs
+		std::vector< std::size_t > poses;
+		for ( std::size_t i = 0; i < indices.size(); i++ )
+		{
+			poses.push_back( m_pairs[ indices[ i ] ] );
+			poses.push_back( m_pairs[ indices[ i ] + 1 ] );
+		}
+		std::sort( poses.begin(), poses.end() );
+		poses.erase( std::unique( poses.begin(), poses.end() ), poses.end() );
+
+		std::vector< Math::Pose > hand;
+		std::vector< Math::Pose > eye;
+		for ( std::size_t i = 0; i < poses.size(); i++ )
+		{
+			hand.push_back( m_hand[ poses[ i ] ] );
+			eye.push_back( m_eye[ poses[ i ] ] );
+		}
+
+		try
+		{
+			result = Calibration::performHandEyeCalibration( hand, eye );
+		}
+		catch ( const Util::Exception& )
+		{
+			// degenerate motions
+			return false;
+		}
+		return true;
+	}
+
+	double error( const Math::Pose& result, std::size_t k ) const
+	{
+		Math::Pose a( m_hand[ m_pairs[ k ] ] * result * m_eye[ m_pairs[ k ] ] );
+		Math::Pose b( m_hand[ m_pairs[ k + 1 ] ] * result * m_eye[ m_pairs[ k + 1 ] ] );
+
+		Math::Vector< double, 3 > d( a.translation() - b.translation() );
+		double distance( std::sqrt( d( 0 ) * d( 0 ) + d( 1 ) * d( 1 ) + d( 2 ) * d( 2 ) ) );
+
+		const Math::Quaternion& qa( a.rotation() );
+		const Math::Quaternion& qb( b.rotation() );
+		double dot( std::fabs( qa.x() * qb.x() + qa.y() * qb.y() + qa.z() * qb.z() + qa.w() * qb.w() ) );
+		double angle( 2.0 * std::acos( std::min( dot, 1.0 ) ) );
+
+		return std::max( distance / m_threshold, angle / m_angleThreshold );
+	}
+
+	void errors( const Math::Pose& result, std::size_t begin, std::size_t end, double* out ) const
+	{
+		for ( std::size_t k = begin; k < end; k++ )
+			out[ k - begin ] = error( result, k );
+	}
+
+protected:
+	const std::vector< Math::Pose >& m_hand;
+	const std::vector< Math::Pose >& m_eye;
+	const std::vector< std::size_t >& m_pairs;
+	double m_threshold;
+	double m_angleThreshold;
+};
+
+
+/**
+ * @ingroup ubitrack_components
+ * robust hand-eye calibration component.
+ *
+ * @par Input Ports
+ * ExpansionInPort< Math::Pose > of name "HandPose", hand pose in the robot coordinate system
+ * ExpansionInPort< Math::Pose > of name "ObjectPose", object pose in the eye coordinate system
+ *
+ * @par Output Ports
+ * TriggerOutPort<Measurement::Pose>> with name "Output".
+ *
+ * @par Configuration
+ * - "minAngle", "maxAngle": range of the hand rotation of a motion pair in degrees, default 20 and 160
+ * - "minAxisAngle": minimum angle between the rotation axes of consecutive motion pairs in degrees, default 30
+ * - "maxPairs": maximum number of motion pairs, default 50
+ * - "threshold": maximum translation error of an inlier motion pair, default 0.01
+ * - "angleThreshold": maximum rotation error of an inlier motion pair in degrees, default 2
+ * - "maxRuns", "confidence", "threads": RANSAC parameters, default 200, 0.99 and 1
+ *
+ * @par Operation
+ * Instead of using all pairs of poses like the HECalibration component, a chain of motion pairs is selected in
+ * one pass over the poses: the next pose is taken if the hand rotated by an angle between minAngle and maxAngle
+ * since the last selected pose, around an axis sufficiently different from the previous motion. Small motions,
+ * which are dominated by noise, and repeated motions around the same axis are thereby skipped. If there are more
+ * than maxPairs motion pairs, the poses are selected again with a larger minAngle, so there are fewer and larger
+ * motion pairs that still satisfy all criteria.
+ *
+ * The calibration is then computed by a ParallelRansac over the motion pairs, taking two motion pairs per
+ * hypothesis, and refined from the poses of all inlier motion pairs. The cost grows linearly with the number
+ * of poses.
+ */
+class RobustHandEyeCalibrationComponent
+	: public Dataflow::TriggerComponent
+{
+public:
+	/**
+	 * Standard component constructor.
+	 *
+	 * @param sName Unique name of the component.
+	 * @param cfg ComponentConfiguration containing all configuration.
+	 */
+	RobustHandEyeCalibrationComponent( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > pCfg )
+		: Dataflow::TriggerComponent( sName, pCfg )
+		, m_handPort( "HandPose", *this )
+		, m_objectPort( "ObjectPose", *this )
+		, m_transfPort( "Output", *this )
+		, m_minAngle( 20.0 )
+		, m_maxAngle( 160.0 )
+		, m_minAxisAngle( 30.0 )
+		, m_maxPairs( 50 )
+		, m_threshold( 0.01 )
+		, m_angleThreshold( 2.0 )
+	{
+		pCfg->m_DataflowAttributes.getAttributeData( "minAngle", m_minAngle );
+		pCfg->m_DataflowAttributes.getAttributeData( "maxAngle", m_maxAngle );
+		pCfg->m_DataflowAttributes.getAttributeData( "minAxisAngle", m_minAxisAngle );
+		pCfg->m_DataflowAttributes.getAttributeData( "maxPairs", m_maxPairs );
+		pCfg->m_DataflowAttributes.getAttributeData( "threshold", m_threshold );
+		pCfg->m_DataflowAttributes.getAttributeData( "angleThreshold", m_angleThreshold );
+
+		m_params.threshold = 1.0;
+		m_params.setSize = 2;
+		m_params.minInliers = 2;
+		m_params.maxRuns = 200;
+		m_params.confidence = 0.99;
+		pCfg->m_DataflowAttributes.getAttributeData( "maxRuns", m_params.maxRuns );
+		pCfg->m_DataflowAttributes.getAttributeData( "confidence", m_params.confidence );
+		pCfg->m_DataflowAttributes.getAttributeData( "threads", m_params.threads );
+
+		if ( m_maxPairs < 2 )
+			UBITRACK_THROW( "maxPairs must be at least 2" );
+
+		m_pPool.reset( new RansacThreadPool( m_params.threads ) );
+	}
+
+	/** Method that computes the result. */
+	void compute( Measurement::Timestamp t )
+	{
+		const std::vector< Math::Pose >& hand( *m_handPort.get() );
+		const std::vector< Math::Pose >& eye( *m_objectPort.get() );
+		if ( hand.size() != eye.size() || hand.size() < 3 )
+			UBITRACK_THROW( "Illegal number of correspondences" );
+
+		std::vector< std::size_t > poses( selectPoses( hand ) );
+		if ( poses.size() < 3 )
+			UBITRACK_THROW( "Not enough well-conditioned motion pairs" );
+
+		const double toRad( 3.14159265358979323846 / 180.0 );
+		HandEyeProblem problem( hand, eye, poses, m_threshold, m_angleThreshold * toRad );
+		ParallelRansac< HandEyeProblem > ransac( problem, m_params, *m_pPool );
+		boost::shared_ptr< Math::Pose > p( new Math::Pose() );
+		std::vector< std::size_t > inliers;
+		unsigned number = ransac.run( *p, inliers );
+
+		LOG4CPP_INFO( logger, "Robust hand-eye calibration selected " << problem.size() << " of " << hand.size() - 1
+			<< " motion pairs, " << inliers.size() << " inliers after " << number << " hypotheses" );
+
+		if ( inliers.empty() )
+			UBITRACK_THROW( "No consistent motion pairs found" );
+
+		m_transfPort.send( Measurement::Pose( t, p ) );
+	}
+
+protected:
+	/**
+	 * selects the chain of poses forming well-conditioned motion pairs.
+	 * If there are more than maxPairs motion pairs, the selection is repeated with a larger minimum angle, found by
+	 * bisection, so every motion pair of the result still satisfies the selection criteria.
+	 */
+	std::vector< std::size_t > selectPoses( const std::vector< Math::Pose >& hand ) const
+	{
+		std::vector< std::size_t > poses( selectPoses( hand, m_minAngle ) );
+		if ( poses.size() <= m_maxPairs + 1 )
+			return poses;
+
+		double low( m_minAngle );
+		double high( m_maxAngle );
+		std::vector< std::size_t > fewer( selectPoses( hand, high ) );
+		for ( int i = 0; i < 20 && fewer.size() != m_maxPairs + 1; i++ )
+		{
+			double minAngle( 0.5 * ( low + high ) );
+			std::vector< std::size_t > selected( selectPoses( hand, minAngle ) );
+			if ( selected.size() > m_maxPairs + 1 )
+				low = minAngle;
+			else
+			{
+				high = minAngle;
+				fewer.swap( selected );
+			}
+		}
+
+		// the number of pairs does not strictly decrease with the angle, so in rare cases there may still be too
+		// many. Any part of the chain satisfies the criteria, so the first maxPairs pairs are used then.
+		if ( fewer.size() > m_maxPairs + 1 )
+			fewer.resize( m_maxPairs + 1 );
+		return fewer;
+	}
+
+	/** selects the chain of poses whose motion pairs rotate by at least minAngle degrees */
+	std::vector< std::size_t > selectPoses( const std::vector< Math::Pose >& hand, double minAngle ) const
+	{
+		const double toRad( 3.14159265358979323846 / 180.0 );
+		const double maxAxisDot( std::cos( m_minAxisAngle * toRad ) );
+
+		std::vector< std::size_t > poses( 1, 0 );
+		Math::Vector< double, 3 > lastAxis( 0.0, 0.0, 0.0 );
+		for ( std::size_t i = 1; i < hand.size(); i++ )
+		{
+			Math::Quaternion delta( ( ~hand[ poses.back() ].rotation() ) * hand[ i ].rotation() );
+			if ( delta.w() < 0 )
+				delta = -delta;
+
+			double angle( 2.0 * std::acos( std::min( delta.w(), 1.0 ) ) );
+			if ( angle < minAngle * toRad || angle > m_maxAngle * toRad )
+				continue;
+
+			double s( std::sqrt( delta.x() * delta.x() + delta.y() * delta.y() + delta.z() * delta.z() ) );
+			Math::Vector< double, 3 > axis( delta.x() / s, delta.y() / s, delta.z() / s );
+			double axisDot( axis( 0 ) * lastAxis( 0 ) + axis( 1 ) * lastAxis( 1 ) + axis( 2 ) * lastAxis( 2 ) );
+			if ( std::fabs( axisDot ) > maxAxisDot )
+				continue;
+
+			poses.push_back( i );
+			lastAxis = axis;
+		}
+		return poses;
+	}
+
+	/** Input port of the component. */
+	Dataflow::ExpansionInPort< Math::Pose > m_handPort;
+	Dataflow::ExpansionInPort< Math::Pose > m_objectPort;
+	/** Output ports of the component. */
+	Dataflow::TriggerOutPort< Measurement::Pose > m_transfPort;
+
+	// motion pair selection
+	double m_minAngle;
+	double m_maxAngle;
+	double m_minAxisAngle;
+	std::size_t m_maxPairs;
+
+	// inlier thresholds
+	double m_threshold;
+	double m_angleThreshold;
+
+	RansacParameters m_params;
+
+	/** threads of the ParallelRansac, started once */
+	boost::scoped_ptr< RansacThreadPool > m_pPool;
+};
+
+
 UBITRACK_REGISTER_COMPONENT( Dataflow::ComponentFactory* const cf ) {
 	cf->registerComponent< HandEyeCalibrationComponent > ( "HECalibration" );
+	cf->registerComponent< RobustHandEyeCalibrationComponent > ( "RobustHECalibration" );
 }
 
 } } // namespace Ubitrack::Components
@@ -0,0 +1,572 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Incremental absolute orientation component.
+ */
+
+#include <map>
+#include <list>
+#include <cmath>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <log4cpp/Category.hh>
+
+#include <utDataflow/Component.h>
+#include <utDataflow/PushConsumer.h>
+#include <utDataflow/PushSupplier.h>
+#include <utDataflow/ComponentFactory.h>
+#include <utMeasurement/Measurement.h>
+
+#include "RunningStatistics.h"
+#include "FixedMatrix.h"
+#include "FixedQuaternion.h"
+
+// get a logger
+static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Events.Components.IncrementalAbsoluteOrientation" ) );
+
+namespace Ubitrack { namespace Components {
+
+/**
+ * Absolute orientation of a changing set of correspondences.
+ *
+ * Keeps the running means and the 6x6 covariance of the stacked correspondences ( a, b ), which contain
+ * the centroids and the 3x3 cross-covariance needed by Horn's closed-form solution. Adding or removing a
+ * correspondence and computing the solution take constant time.
+ */
+class IncrementalAbsoluteOrientation
+{
+public:
+	/** adds a correspondence, x contains a followed by b */
+	void add( const double* x )
+	{ m_statistics.add( x ); }
+
+	/** removes a correspondence that was added before */
+	void remove( const double* x )
+	{ m_statistics.remove( x ); }
+
+	void reset()
+	{ m_statistics.reset(); }
+
+	std::size_t size() const
+	{ return m_statistics.count(); }
+
+	/**
+	 * computes the pose that transforms the points a to the points b, b = R a + t.
+	 * @param rms set to the root mean square distance of the transformed correspondences
+	 */
+	Math::Pose solve( double& rms ) const
+	{
+		// cross-covariance S( i, j ) of a_i and b_j
+		double s[ 3 ][ 3 ];
+		for ( std::size_t i = 0; i < 3; i++ )
+			for ( std::size_t j = 0; j < 3; j++ )
+				s[ i ][ j ] = m_statistics.covariance( i, 3 + j );
+
+		// Horn's symmetric matrix, whose largest eigenvector is the rotation quaternion ( w, x, y, z )
+		double n[ 4 ][ 4 ] = {
+			{ s[ 0 ][ 0 ] + s[ 1 ][ 1 ] + s[ 2 ][ 2 ], s[ 1 ][ 2 ] - s[ 2 ][ 1 ], s[ 2 ][ 0 ] - s[ 0 ][ 2 ], s[ 0 ][ 1 ] - s[ 1 ][ 0 ] },
+			{ s[ 1 ][ 2 ] - s[ 2 ][ 1 ], s[ 0 ][ 0 ] - s[ 1 ][ 1 ] - s[ 2 ][ 2 ], s[ 0 ][ 1 ] + s[ 1 ][ 0 ], s[ 2 ][ 0 ] + s[ 0 ][ 2 ] },
+			{ s[ 2 ][ 0 ] - s[ 0 ][ 2 ], s[ 0 ][ 1 ] + s[ 1 ][ 0 ], -s[ 0 ][ 0 ] + s[ 1 ][ 1 ] - s[ 2 ][ 2 ], s[ 1 ][ 2 ] + s[ 2 ][ 1 ] },
+			{ s[ 0 ][ 1 ] - s[ 1 ][ 0 ], s[ 2 ][ 0 ] + s[ 0 ][ 2 ], s[ 1 ][ 2 ] + s[ 2 ][ 1 ], -s[ 0 ][ 0 ] - s[ 1 ][ 1 ] + s[ 2 ][ 2 ] } };
+		double q[ 4 ];
+		largestEigenvector( n, q );
+		Math::Quaternion rotation( q[ 1 ], q[ 2 ], q[ 3 ], q[ 0 ] );
+
+		const double* mean( m_statistics.mean() );
+		Math::Vector< double, 3 > ca( mean[ 0 ], mean[ 1 ], mean[ 2 ] );
+		Math::Vector< double, 3 > cb( mean[ 3 ], mean[ 4 ], mean[ 5 ] );
+		Math::Vector< double, 3 > translation( cb - rotation * ca );
+
+		// mean squared distance: tr( Saa ) + tr( Sbb ) - 2 tr( R S )
+		double mse( 0.0 );
+		for ( std::size_t i = 0; i < 6; i++ )
+			mse += m_statistics.covariance( i, i );
+		for ( std::size_t j = 0; j < 3; j++ )
+		{
+			Math::Vector< double, 3 > axis( 0.0, 0.0, 0.0 );
+			axis( j ) = 1.0;
+			Math::Vector< double, 3 > column( rotation * axis );
+			for ( std::size_t i = 0; i < 3; i++ )
+				mse -= 2.0 * column( i ) * s[ j ][ i ];
+		}
+		rms = std::sqrt( std::max( mse, 0.0 ) );
+
+		return Math::Pose( rotation, translation );
+	}
+
+	/**
+	 * computes the covariance of a solution, assuming isotropic noise of the residuals.
+	 *
+	 * The rotation error theta, with R' = R exp( [ theta ]x ), has the covariance sigma^2 / n ( tr( Saa ) I - Saa )^-1,
+	 * so it shrinks with the spread of the points of a. As t = cb - R ca, a rotation error moves the translation by
+	 * R [ ca ]x theta in addition to the error of the centroid, sigma^2 / n I. Like in the other ErrorPoses, the
+	 * rotation block holds the covariance of the imaginary part of the error quaternion, i.e. of theta / 2.
+	 *
+	 * @param pose the solution
+	 * @param rms its root mean square distance, as computed by solve
+	 * @return false if the points of a are collinear and do not determine the rotation
+	 */
+	bool covariance( const Math::Pose& pose, double rms, Math::Matrix< double, 6, 6 >& covariance ) const
+	{
+		const double n( double( m_statistics.count() ) );
+
+		// variance of a residual coordinate, corrected for the six estimated parameters
+		const double sigma2( n * rms * rms / ( 3.0 * n - 6.0 ) );
+
+		const double trace( m_statistics.covariance( 0, 0 ) + m_statistics.covariance( 1, 1 ) + m_statistics.covariance( 2, 2 ) );
+		FixedMatrix< 3, 3 > info;
+		for ( std::size_t i = 0; i < 3; i++ )
+			for ( std::size_t j = 0; j < 3; j++ )
+				info( i, j ) = ( i == j ? trace : 0.0 ) - m_statistics.covariance( i, j );
+
+		FixedMatrix< 3, 3 > chol;
+		if ( !cholesky( info, chol ) )
+			return false;
+		for ( std::size_t i = 0; i < 3; i++ )
+			if ( chol( i, i ) * chol( i, i ) < 1e-6 * trace )
+				return false;
+
+		FixedMatrix< 3, 3 > rotationCov( FixedMatrix< 3, 3 >::identity() );
+		choleskySolve( chol, rotationCov );
+		for ( std::size_t i = 0; i < 3; i++ )
+			for ( std::size_t j = 0; j < 3; j++ )
+				rotationCov( i, j ) *= sigma2 / n;
+
+		// m = R [ ca ]x
+		const double* mean( m_statistics.mean() );
+		const double skew[ 3 ][ 3 ] = {
+			{ 0.0, -mean[ 2 ], mean[ 1 ] },
+			{ mean[ 2 ], 0.0, -mean[ 0 ] },
+			{ -mean[ 1 ], mean[ 0 ], 0.0 } };
+		FixedMatrix< 3, 3 > r;
+		FixedMatrix< 3, 3 > m;
+		for ( std::size_t j = 0; j < 3; j++ )
+		{
+			Math::Vector< double, 3 > axis( 0.0, 0.0, 0.0 );
+			axis( j ) = 1.0;
+			Math::Vector< double, 3 > column( pose.rotation() * axis );
+			for ( std::size_t i = 0; i < 3; i++ )
+				r( i, j ) = column( i );
+		}
+		for ( std::size_t i = 0; i < 3; i++ )
+			for ( std::size_t j = 0; j < 3; j++ )
+				m( i, j ) = r( i, 0 ) * skew[ 0 ][ j ] + r( i, 1 ) * skew[ 1 ][ j ] + r( i, 2 ) * skew[ 2 ][ j ];
+
+		FixedMatrix< 3, 3 > translationCov;
+		FixedMatrix< 3, 3 > crossCov;
+		similarity( m, rotationCov, translationCov );
+		multiply( m, rotationCov, crossCov );
+
+		for ( std::size_t i = 0; i < 3; i++ )
+			for ( std::size_t j = 0; j < 3; j++ )
+			{
+				covariance( i, j ) = translationCov( i, j ) + ( i == j ? sigma2 / n : 0.0 );
+				covariance( i, 3 + j ) = covariance( 3 + j, i ) = 0.5 * crossCov( i, j );
+				covariance( 3 + i, 3 + j ) = 0.25 * rotationCov( i, j );
+			}
+		return true;
+	}
+
+protected:
+	RunningStatistics< 6 > m_statistics;
+};
+
+
+/**
+ * @ingroup dataflow_components
+ * Absolute orientation of a growing set of correspondences.
+ *
+ * @par Input Ports
+ * PushConsumer< Position > with name "InputA".
+ * PushConsumer< Position > with name "InputB".
+ *
+ * @par Output Ports
+ * PushSupplier< ErrorPose > with name "Output".
+ *
+ * @par Configuration
+ * - DataflowConfiguration Attribute "maxCorrespondences": size of a sliding window of correspondences, 0 (default) for all
+ * - DataflowConfiguration Attribute "outlierThreshold": maximum residual of a correspondence, 0 (default) disables the outlier rejection
+ * - DataflowConfiguration Attribute "minCorrespondences": number of correspondences needed before outliers are rejected, default 6
+ *
+ * @par Operation
+ * Measurements of InputA and InputB with the same timestamp form a correspondence. Like the AbsoluteOrientation
+ * component, the pose from A to B is computed, but with an IncrementalAbsoluteOrientation, so every new
+ * correspondence costs constant time instead of a solution from all correspondences.
+ * The pose is sent for every correspondence once there are at least three non-collinear points in A. Its
+ * covariance is derived from the residuals and the spread of the points, see IncrementalAbsoluteOrientation::covariance.
+ *
+ * With outlier rejection, a new correspondence is rejected if its residual with respect to the current pose exceeds
+ * the threshold. The residual is stored with each correspondence. For every new correspondence, the stored residual
+ * of one correspondence is updated in round-robin fashion, and the correspondence with the largest stored residual
+ * is checked again and removed if it is an outlier. Then one rejected correspondence is checked again, also in
+ * round-robin fashion, and re-admitted if it fits the current pose. This keeps the cost per correspondence at
+ * O(log n). Re-admitted correspondences count as new ones for the sliding window.
+ *
+ * As many rejected correspondences are kept as there are stored ones. After that many rejections, the stored ones
+ * may be the outliers, e.g. if early outliers skewed the pose. The pose is then also computed from the rejected
+ * correspondences, and if more of all correspondences fit it, they are sorted again into stored and rejected ones.
+ */
+class IncrementalAbsoluteOrientationComponent
+	: public Dataflow::Component
+{
+public:
+	/**
+	 * UTQL component constructor.
+	 *
+	 * @param sName Unique name of the component.
+	 * @param subgraph UTQL subgraph
+	 */
+	IncrementalAbsoluteOrientationComponent( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
+		: Dataflow::Component( sName )
+		, m_inPortA( "InputA", *this, boost::bind( &IncrementalAbsoluteOrientationComponent::receiveA, this, _1 ) )
+		, m_inPortB( "InputB", *this, boost::bind( &IncrementalAbsoluteOrientationComponent::receiveB, this, _1 ) )
+		, m_outPort( "Output", *this )
+		, m_maxCorrespondences( 0 )
+		, m_minCorrespondences( 6 )
+		, m_outlierThreshold( 0.0 )
+		, m_timeA( 0 )
+		, m_timeB( 0 )
+		, m_rejectedSinceReset( 0 )
+		, m_removed( 0 )
+		, m_rms( 0.0 )
+	{
+		subgraph->m_DataflowAttributes.getAttributeData( "maxCorrespondences", m_maxCorrespondences );
+		subgraph->m_DataflowAttributes.getAttributeData( "minCorrespondences", m_minCorrespondences );
+		subgraph->m_DataflowAttributes.getAttributeData( "outlierThreshold", m_outlierThreshold );
+		m_minCorrespondences = std::max( m_minCorrespondences, std::size_t( 3 ) );
+		m_check = m_correspondences.end();
+		m_checkRejected = m_rejected.end();
+	}
+
+	void receiveA( const Measurement::Position& m )
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+		m_a = *m;
+		m_timeA = m.time();
+		if ( m_timeB == m.time() )
+			addCorrespondence( m.time() );
+	}
+
+	void receiveB( const Measurement::Position& m )
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+		m_b = *m;
+		m_timeB = m.time();
+		if ( m_timeA == m.time() )
+			addCorrespondence( m.time() );
+	}
+
+protected:
+	/** a stored correspondence */
+	struct Correspondence
+	{
+		double x[ 6 ];
+
+		/** distance of b and the transformed a when last checked */
+		double residual;
+	};
+
+	typedef std::list< Correspondence > CorrespondenceList;
+
+	/** stored correspondences ordered by their stored residual */
+	typedef std::multimap< double, CorrespondenceList::iterator > ResidualMap;
+
+	/** adds the last measurements as correspondence and sends the new pose, must be called with locked mutex */
+	void addCorrespondence( Measurement::Timestamp t )
+	{
+		Correspondence c;
+		for ( std::size_t i = 0; i < 3; i++ )
+		{
+			c.x[ i ] = m_a( i );
+			c.x[ 3 + i ] = m_b( i );
+		}
+		m_timeA = m_timeB = 0;
+
+		bool bRejecting( m_outlierThreshold > 0.0 && m_solver.size() >= m_minCorrespondences );
+		c.residual = bRejecting ? residual( c ) : 0.0;
+		if ( bRejecting && c.residual > m_outlierThreshold )
+		{
+			LOG4CPP_DEBUG( logger, getName() << ": rejected correspondence with residual " << c.residual );
+			rejectCorrespondence( c );
+
+			// after as many rejections as there are stored correspondences, the stored ones may be the outliers
+			if ( ++m_rejectedSinceReset < std::max( m_correspondences.size(), m_minCorrespondences ) || !resetCorrespondences() )
+				return;
+		}
+		else
+		{
+			storeCorrespondence( c );
+			if ( m_maxCorrespondences > 0 && m_correspondences.size() > m_maxCorrespondences )
+				removeCorrespondence( m_correspondences.begin() );
+
+			if ( m_solver.size() < 3 )
+				return;
+
+			m_pose = m_solver.solve( m_rms );
+
+			if ( bRejecting )
+				checkCorrespondences();
+		}
+
+		Math::Matrix< double, 6, 6 > covariance;
+		if ( !m_solver.covariance( m_pose, m_rms, covariance ) )
+		{
+			LOG4CPP_DEBUG( logger, getName() << ": correspondences do not determine the rotation yet" );
+			return;
+		}
+
+		LOG4CPP_DEBUG( logger, getName() << ": " << m_solver.size() << " correspondences, rms " << m_rms );
+		m_outPort.send( Measurement::ErrorPose( t, Math::ErrorPose( m_pose, covariance ) ) );
+	}
+
+	/**
+	 * updates the stored residual of the next correspondence, removes the correspondence with the largest
+	 * stored residual if it is an outlier and checks the next rejected correspondence again
+	 */
+	void checkCorrespondences()
+	{
+		if ( m_check == m_correspondences.end() )
+			m_check = m_correspondences.begin();
+		updateResidual( m_check++ );
+
+		CorrespondenceList::iterator it( ( --m_residuals.end() )->second );
+		updateResidual( it );
+		if ( it->residual > m_outlierThreshold && m_solver.size() > m_minCorrespondences )
+		{
+			LOG4CPP_DEBUG( logger, getName() << ": removed correspondence with residual " << it->residual );
+			rejectCorrespondence( *it );
+			removeCorrespondence( it );
+			m_pose = m_solver.solve( m_rms );
+		}
+
+		readmitCorrespondence();
+	}
+
+	/** checks the next rejected correspondence with the current pose and stores it if it is no outlier */
+	void readmitCorrespondence()
+	{
+		if ( m_checkRejected == m_rejected.end() )
+			m_checkRejected = m_rejected.begin();
+		if ( m_checkRejected == m_rejected.end() )
+			return;
+
+		CorrespondenceList::iterator it( m_checkRejected++ );
+		it->residual = residual( *it );
+		if ( it->residual > m_outlierThreshold )
+			return;
+
+		LOG4CPP_DEBUG( logger, getName() << ": re-admitted correspondence with residual " << it->residual );
+		storeCorrespondence( *it );
+		m_rejected.erase( it );
+
+		if ( m_maxCorrespondences > 0 && m_correspondences.size() > m_maxCorrespondences )
+			removeCorrespondence( m_correspondences.begin() );
+		m_pose = m_solver.solve( m_rms );
+	}
+
+	/**
+	 * solves from the rejected correspondences and keeps that pose if more of all correspondences fit it.
+	 * All correspondences are then sorted again into stored and rejected ones.
+	 * @return true if the pose changed
+	 */
+	bool resetCorrespondences()
+	{
+		m_rejectedSinceReset = 0;
+
+		IncrementalAbsoluteOrientation rejectedSolver;
+		for ( CorrespondenceList::iterator it = m_rejected.begin(); it != m_rejected.end(); it++ )
+			rejectedSolver.add( it->x );
+		double rms;
+		Math::Pose current( m_pose );
+		Math::Pose candidate( rejectedSolver.solve( rms ) );
+
+		CorrespondenceList all( m_correspondences );
+		all.insert( all.end(), m_rejected.begin(), m_rejected.end() );
+		std::size_t nCurrent( 0 );
+		std::size_t nCandidate( 0 );
+		for ( CorrespondenceList::iterator it = all.begin(); it != all.end(); it++ )
+		{
+			m_pose = current;
+			nCurrent += residual( *it ) <= m_outlierThreshold;
+			m_pose = candidate;
+			nCandidate += residual( *it ) <= m_outlierThreshold;
+		}
+
+		if ( nCandidate <= nCurrent || nCandidate < m_minCorrespondences )
+		{
+			m_pose = current;
+			return false;
+		}
+
+		LOG4CPP_DEBUG( logger, getName() << ": " << nCandidate << " correspondences fit the rejected ones, "
+			<< nCurrent << " the stored ones, using the rejected ones" );
+
+		m_correspondences.clear();
+		m_residuals.clear();
+		m_rejected.clear();
+		m_check = m_correspondences.end();
+		m_checkRejected = m_rejected.end();
+		m_solver.reset();
+		m_removed = 0;
+
+		for ( CorrespondenceList::iterator it = all.begin(); it != all.end(); it++ )
+		{
+			it->residual = residual( *it );
+			if ( it->residual <= m_outlierThreshold )
+				storeCorrespondence( *it );
+		}
+		for ( CorrespondenceList::iterator it = all.begin(); it != all.end(); it++ )
+			if ( it->residual > m_outlierThreshold )
+				rejectCorrespondence( *it );
+
+		while ( m_maxCorrespondences > 0 && m_correspondences.size() > m_maxCorrespondences )
+			removeCorrespondence( m_correspondences.begin() );
+		m_pose = m_solver.solve( m_rms );
+		return true;
+	}
+
+	/** keeps a rejected correspondence, dropping the oldest if there are more rejected than stored ones */
+	void rejectCorrespondence( const Correspondence& c )
+	{
+		m_rejected.push_back( c );
+		while ( m_rejected.size() > std::max( m_correspondences.size(), m_minCorrespondences ) )
+		{
+			if ( m_checkRejected == m_rejected.begin() )
+				m_checkRejected++;
+			m_rejected.pop_front();
+		}
+	}
+
+	/** adds a correspondence to the stored ones */
+	void storeCorrespondence( const Correspondence& c )
+	{
+		CorrespondenceList::iterator pos( m_correspondences.insert( m_correspondences.end(), c ) );
+		m_residuals.insert( ResidualMap::value_type( c.residual, pos ) );
+		m_solver.add( c.x );
+	}
+
+	/** removes a stored correspondence */
+	void removeCorrespondence( CorrespondenceList::iterator it )
+	{
+		if ( m_check == it )
+			m_check++;
+		m_residuals.erase( findResidual( it ) );
+		m_solver.remove( it->x );
+		m_correspondences.erase( it );
+
+		// removing accumulates rounding errors, so the statistics are recomputed after as many removals
+		// as there are correspondences, which keeps the cost per correspondence constant
+		if ( ++m_removed >= m_correspondences.size() )
+			resetStatistics();
+	}
+
+	/** recomputes the statistics from the stored correspondences */
+	void resetStatistics()
+	{
+		m_removed = 0;
+		m_solver.reset();
+		for ( CorrespondenceList::iterator it = m_correspondences.begin(); it != m_correspondences.end(); it++ )
+			m_solver.add( it->x );
+	}
+
+	/** recomputes the residual of a stored correspondence */
+	void updateResidual( CorrespondenceList::iterator it )
+	{
+		m_residuals.erase( findResidual( it ) );
+		it->residual = residual( *it );
+		m_residuals.insert( ResidualMap::value_type( it->residual, it ) );
+	}
+
+	/** entry of a stored correspondence in m_residuals */
+	ResidualMap::iterator findResidual( CorrespondenceList::iterator it )
+	{
+		std::pair< ResidualMap::iterator, ResidualMap::iterator > range( m_residuals.equal_range( it->residual ) );
+		while ( range.first->second != it )
+			range.first++;
+		return range.first;
+	}
+
+	/** distance of b and the transformed a with the current pose */
+	double residual( const Correspondence& c ) const
+	{
+		Math::Vector< double, 3 > a( c.x[ 0 ], c.x[ 1 ], c.x[ 2 ] );
+		Math::Vector< double, 3 > b( c.x[ 3 ], c.x[ 4 ], c.x[ 5 ] );
+		Math::Vector< double, 3 > d( m_pose * a - b );
+		return std::sqrt( d( 0 ) * d( 0 ) + d( 1 ) * d( 1 ) + d( 2 ) * d( 2 ) );
+	}
+
+	Dataflow::PushConsumer< Measurement::Position > m_inPortA;
+	Dataflow::PushConsumer< Measurement::Position > m_inPortB;
+	Dataflow::PushSupplier< Measurement::ErrorPose > m_outPort;
+
+	std::size_t m_maxCorrespondences;
+	std::size_t m_minCorrespondences;
+	double m_outlierThreshold;
+
+	boost::mutex m_mutex;
+
+	/** last measurements of both inputs and their times, 0 if already part of a correspondence */
+	Math::Vector< double, 3 > m_a;
+	Math::Vector< double, 3 > m_b;
+	Measurement::Timestamp m_timeA;
+	Measurement::Timestamp m_timeB;
+
+	/** stored correspondences in the order they were stored */
+	CorrespondenceList m_correspondences;
+
+	/** stored correspondences by residual */
+	ResidualMap m_residuals;
+
+	/** next correspondence whose residual is updated */
+	CorrespondenceList::iterator m_check;
+
+	/** rejected correspondences, oldest first */
+	CorrespondenceList m_rejected;
+
+	/** next rejected correspondence that is checked again */
+	CorrespondenceList::iterator m_checkRejected;
+
+	/** rejections since the correspondences were last sorted again */
+	std::size_t m_rejectedSinceReset;
+
+	/** removals since the statistics were last recomputed */
+	std::size_t m_removed;
+
+	IncrementalAbsoluteOrientation m_solver;
+
+	/** current solution */
+	Math::Pose m_pose;
+	double m_rms;
+};
+
+
+UBITRACK_REGISTER_COMPONENT( Dataflow::ComponentFactory* const cf ) {
+	cf->registerComponent< IncrementalAbsoluteOrientationComponent > ( "IncrementalAbsoluteOrientation" );
+}
+
+} } // namespace Ubitrack::Components
@@ -0,0 +1,88 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#ifndef __UBITRACK_COMPONENTS_LISTPOOL_H_INCLUDED__
+#define __UBITRACK_COMPONENTS_LISTPOOL_H_INCLUDED__
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Pool of recycled output lists
+ */
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace Ubitrack { namespace Components {
+
+/**
+ * @ingroup dataflow_components
+ * Pool of lists for list measurements that are sent by a component.
+ *
+ * Measurements share their value with all receivers. A list from the pool is handed out
+ * again as soon as no measurement refers to it any more, keeping its capacity, so
+ * components that build a list per event do not allocate in steady state.
+ *
+ * \c acquire may be called concurrently, e.g. from a pull supplier that is pulled by several threads.
+ */
+template< class ListType >
+class ListPool
+{
+public:
+	/**
+	 * @param maxSize maximum number of lists kept for recycling. If all of them are still
+	 *   in use, additional lists are allocated and not recycled.
+	 */
+	ListPool( std::size_t maxSize = 4 )
+		: m_maxSize( maxSize )
+	{}
+
+	/** returns an empty list that is not referenced anywhere else */
+	boost::shared_ptr< ListType > acquire()
+	{
+		// two concurrent callers must not both find the same list unique
+		boost::mutex::scoped_lock l( m_mutex );
+
+		for ( typename std::vector< boost::shared_ptr< ListType > >::iterator it = m_lists.begin(); it != m_lists.end(); it++ )
+			if ( it->unique() )
+			{
+				( *it )->clear();
+				return *it;
+			}
+
+		boost::shared_ptr< ListType > pList( new ListType );
+		if ( m_lists.size() < m_maxSize )
+			m_lists.push_back( pList );
+		return pList;
+	}
+
+protected:
+	boost::mutex m_mutex;
+	std::size_t m_maxSize;
+	std::vector< boost::shared_ptr< ListType > > m_lists;
+};
+
+} } // namespace Ubitrack::Components
+
+#endif
@@ -0,0 +1,237 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Component for kalman filtering of many poses
+ */
+
+#include <map>
+#include <vector>
+#include <sstream>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <log4cpp/Category.hh>
+
+#include <utDataflow/Component.h>
+#include <utDataflow/PushConsumer.h>
+#include <utDataflow/PullSupplier.h>
+#include <utDataflow/PushSupplier.h>
+#include <utDataflow/ComponentFactory.h>
+#include <utMeasurement/Measurement.h>
+#include <utUtil/Exception.h>
+
+#include "FixedPoseKalmanFilter.h"
+
+// get a logger
+static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Events.Components.MultiPoseKalmanFilter" ) );
+
+namespace Ubitrack { namespace Components {
+
+/** filters of all targets */
+class MultiPoseFilter
+{
+public:
+	virtual ~MultiPoseFilter()
+	{}
+
+	virtual void addPoseMeasurement( std::size_t target, const Measurement::ErrorPose& m ) = 0;
+	virtual Measurement::ErrorPose predictPose( std::size_t target, Measurement::Timestamp t ) const = 0;
+};
+
+
+/** the filters of all targets in one contiguous array */
+template< std::size_t PosOrder, std::size_t OriOrder >
+class MultiPoseFilterImpl
+	: public MultiPoseFilter
+{
+public:
+	MultiPoseFilterImpl( std::size_t nTargets, const std::vector< double >& posPN, const std::vector< double >& oriPN )
+		: m_filters( nTargets, FixedPoseKalmanFilter< PosOrder, OriOrder >( posPN, oriPN ) )
+	{}
+
+	virtual void addPoseMeasurement( std::size_t target, const Measurement::ErrorPose& m )
+	{ m_filters[ target ].addPoseMeasurement( m ); }
+
+	virtual Measurement::ErrorPose predictPose( std::size_t target, Measurement::Timestamp t ) const
+	{ return m_filters[ target ].predictPose( t ); }
+
+protected:
+	std::vector< FixedPoseKalmanFilter< PosOrder, OriOrder > > m_filters;
+};
+
+
+/**
+ * @ingroup dataflow_components
+ * Kalman filter for many independent targets, each tracked by poses.
+ *
+ * @par Input Ports
+ * PushConsumer< ErrorPose > with names starting with "InPose". Each input defines a target,
+ * identified by the rest of the edge name, e.g. "InPose1" or "InPoseTool".
+ *
+ * @par Output Ports
+ * PullSupplier< ErrorPose > with name "OutPose" followed by the target name.
+ * PushSupplier< ErrorPose > with name "OutPosePush" followed by the target name. An output "OutPosePushX" is
+ * the pull output of a target "PushX" if there is one, and it is an error if targets "X" and "PushX" both exist.
+ *
+ * @par Configuration
+ * - DataflowConfiguration Attribute "posPN": sequence of one or two floats
+ * - DataflowConfiguration Attribute "oriPN": sequence of two or three floats
+ *
+ * @par Operation
+ * Each target is tracked by an outside-in FixedPoseKalmanFilter with the given motion model, like the
+ * PoseKalmanFilter component with fixedSize="true". The states of all targets are kept in one contiguous
+ * array of fixed-size filters, so many targets neither need a component each nor any heap allocations
+ * per update.
+ */
+class MultiPoseKalmanFilterComponent
+	: public Dataflow::Component
+{
+public:
+	/**
+	 * UTQL component constructor.
+	 *
+	 * @param sName Unique name of the component.
+	 * @param subgraph UTQL subgraph
+	 */
+	MultiPoseKalmanFilterComponent( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
+		: Dataflow::Component( sName )
+	{
+		// one target per input
+		std::map< std::string, std::size_t > targets;
+		for ( Graph::UTQLSubgraph::EdgeMap::iterator it = subgraph->m_Edges.begin(); it != subgraph->m_Edges.end(); it++ )
+			if ( it->second->isInput() && 0 == it->first.compare( 0, 6, "InPose" ) )
+			{
+				std::size_t target( m_targets.size() );
+				targets[ it->first.substr( 6 ) ] = target;
+				m_targets.push_back( Target() );
+				m_targets.back().pIn.reset( new Dataflow::PushConsumer< Measurement::ErrorPose >( it->first, *this,
+					boost::bind( &MultiPoseKalmanFilterComponent::receivePose, this, _1, target ) ) );
+			}
+
+		// outputs of the targets
+		for ( Graph::UTQLSubgraph::EdgeMap::iterator it = subgraph->m_Edges.begin(); it != subgraph->m_Edges.end(); it++ )
+		{
+			if ( it->second->isInput() )
+				continue;
+
+			if ( 0 != it->first.compare( 0, 7, "OutPose" ) )
+				continue;
+
+			// "OutPosePushX" is the pull output of target "PushX" if there is one, otherwise the push output of "X"
+			std::map< std::string, std::size_t >::iterator itTarget = targets.find( it->first.substr( 7 ) );
+			bool bPush( false );
+			if ( 0 == it->first.compare( 0, 11, "OutPosePush" ) )
+			{
+				std::map< std::string, std::size_t >::iterator itPushTarget = targets.find( it->first.substr( 11 ) );
+				if ( itTarget != targets.end() && itPushTarget != targets.end() )
+					UBITRACK_THROW( "Output " + it->first + " is ambiguous, rename target " + it->first.substr( 7 ) );
+				if ( itTarget == targets.end() )
+				{
+					itTarget = itPushTarget;
+					bPush = true;
+				}
+			}
+			if ( itTarget == targets.end() )
+				UBITRACK_THROW( "No input for output " + it->first );
+
+			Target& target( m_targets[ itTarget->second ] );
+			if ( bPush )
+				target.pOutPush.reset( new Dataflow::PushSupplier< Measurement::ErrorPose >( it->first, *this ) );
+			else
+				target.pOut.reset( new Dataflow::PullSupplier< Measurement::ErrorPose >( it->first, *this,
+					boost::bind( &MultiPoseKalmanFilterComponent::sendOut, this, _1, itTarget->second ) ) );
+		}
+
+		// motion model
+		std::vector< double > posPN( readPN( subgraph, "posPN", "0.6" ) );
+		std::vector< double > oriPN( readPN( subgraph, "oriPN", "0.07 3.6" ) );
+
+		if ( posPN.size() == 1 && oriPN.size() == 2 )
+			m_pFilters.reset( new MultiPoseFilterImpl< 0, 1 >( m_targets.size(), posPN, oriPN ) );
+		else if ( posPN.size() == 2 && oriPN.size() == 2 )
+			m_pFilters.reset( new MultiPoseFilterImpl< 1, 1 >( m_targets.size(), posPN, oriPN ) );
+		else if ( posPN.size() == 2 && oriPN.size() == 3 )
+			m_pFilters.reset( new MultiPoseFilterImpl< 1, 2 >( m_targets.size(), posPN, oriPN ) );
+		else
+			UBITRACK_THROW( "MultiPoseKalmanFilter supports one or two posPN values and two or three oriPN values" );
+
+		LOG4CPP_INFO( logger, getName() << ": tracking " << m_targets.size() << " targets" );
+	}
+
+	/** integrates a pose measurement of a target */
+	void receivePose( const Measurement::ErrorPose& m, std::size_t target )
+	{
+		LOG4CPP_DEBUG( logger, "Received pose measurement for target " << target << ": " << m );
+
+		m_pFilters->addPoseMeasurement( target, m );
+
+		Target& t( m_targets[ target ] );
+		if ( t.pOutPush && t.pOutPush->isConnected() && t.pIn->getQueuedEvents() == 0 )
+			t.pOutPush->send( m_pFilters->predictPose( target, m.time() ) );
+	}
+
+	/** Method that returns a predicted measurement. */
+	Measurement::ErrorPose sendOut( Measurement::Timestamp t, std::size_t target )
+	{
+		return m_pFilters->predictPose( target, t );
+	}
+
+protected:
+	/** reads a sequence of process noise values */
+	static std::vector< double > readPN( boost::shared_ptr< Graph::UTQLSubgraph > subgraph, const std::string& name, const std::string& sDefault )
+	{
+		std::string sPN( sDefault );
+		if ( subgraph->m_DataflowAttributes.hasAttribute( name ) )
+			sPN = subgraph->m_DataflowAttributes.getAttributeString( name );
+
+		std::vector< double > pn;
+		std::istringstream inStream( sPN );
+		double d;
+		while ( inStream >> d )
+			pn.push_back( d );
+		return pn;
+	}
+
+	/** ports of a target */
+	struct Target
+	{
+		boost::shared_ptr< Dataflow::PushConsumer< Measurement::ErrorPose > > pIn;
+		boost::shared_ptr< Dataflow::PullSupplier< Measurement::ErrorPose > > pOut;
+		boost::shared_ptr< Dataflow::PushSupplier< Measurement::ErrorPose > > pOutPush;
+	};
+
+	std::vector< Target > m_targets;
+
+	// the filters of all targets
+	boost::scoped_ptr< MultiPoseFilter > m_pFilters;
+};
+
+
+UBITRACK_REGISTER_COMPONENT( Dataflow::ComponentFactory* const cf ) {
+	cf->registerComponent< MultiPoseKalmanFilterComponent > ( "MultiPoseKalmanFilter" );
+}
+
+} } // namespace Ubitrack::Components
@@ -41,6 +41,8 @@
 #include <utMeasurement/Measurement.h>
 #include <utCalibration/OnlineRotHec.h>
 
+#include "PredictionCache.h"
+
 // get a logger
 static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Components.OnlineRotHec" ) );
 
@@ -140,6 +142,7 @@ public:
 					// compute all pairs
 					for ( std::size_t i = 0; i < m_bufferA.size(); i++ )
 						m_hec.addMeasurement( (~qa) * m_bufferA[ i ], (~qb) * m_bufferB[ i ] );
+					m_results.invalidate();
 					LOG4CPP_DEBUG( logger, "Computed transformation " << m_hec.computeResult() );
 					
 					m_bufferA.push_back( qa );
@@ -177,7 +180,14 @@ public:
 
 	Measurement::Rotation sendOut( Measurement::Timestamp t )
 	{
-		return Measurement::Rotation( t, m_hec.computeResult() );
+		unsigned long generation;
+		Measurement::Rotation m;
+		if ( !m_results.lookup( t, m, generation ) )
+		{
+			m = Measurement::Rotation( t, m_hec.computeResult() );
+			m_results.store( t, m, generation );
+		}
+		return m;
 	}
 
 protected:
@@ -202,6 +212,9 @@ protected:
 	// Output ports of the component
 	Dataflow::PullSupplier< Measurement::Rotation > m_out;
 
+	// results of recent requests, invalidated when a measurement is added
+	PredictionCache< Measurement::Rotation > m_results;
+
 	// the kalman filter
 	Calibration::OnlineRotHec m_hec;
 };
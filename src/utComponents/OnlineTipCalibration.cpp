@@ -0,0 +1,218 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Online tip/hotspot calibration component.
+ */
+
+#include <cmath>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <log4cpp/Category.hh>
+
+#include <utDataflow/Component.h>
+#include <utDataflow/PushConsumer.h>
+#include <utDataflow/PushSupplier.h>
+#include <utDataflow/ComponentFactory.h>
+#include <utMeasurement/Measurement.h>
+
+#include "FixedMatrix.h"
+
+// get a logger
+static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Events.Components.OnlineTipCalibration" ) );
+
+namespace Ubitrack { namespace Components {
+
+/**
+ * @ingroup dataflow_components
+ * Online tip/hotspot calibration component.
+ *
+ * @par Input Ports
+ * PushConsumer< Pose > with name "Input".
+ *
+ * @par Output Ports
+ * PushSupplier< Position > with name "Output", the tip in the marker frame.
+ * PushSupplier< Position > with name "Pivot", the pivot point in the tracker frame.
+ * PushSupplier< Distance > with name "Residual", the root mean square distance of the tip positions to the pivot.
+ *
+ * @par Configuration
+ * - DataflowConfiguration Attribute "forgetting": weight of the previous poses for every new pose, 1 (default) keeps all poses
+ * - DataflowConfiguration Attribute "minPoses": number of poses before the first result is sent, default 10
+ *
+ * @par Operation
+ * Like the TipCalibration component, solves R_i * tip + t_i = pivot in the least squares sense, but from
+ * poses that are pushed one at a time. The normal equations only depend on the weighted sums of
+ * R_i, R_i^T t_i, t_i and |t_i|^2, so every pose updates them in constant time, and the 6x6 system is
+ * solved again after every pose. With a forgetting factor below one, this is a recursive least squares
+ * estimate that follows a changing tip.
+ *
+ * No result is sent while the rotations do not determine the tip, i.e. before the marker was rotated
+ * around two different axes.
+ */
+class OnlineTipCalibrationComponent
+	: public Dataflow::Component
+{
+public:
+	/**
+	 * UTQL component constructor.
+	 *
+	 * @param sName Unique name of the component.
+	 * @param subgraph UTQL subgraph
+	 */
+	OnlineTipCalibrationComponent( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
+		: Dataflow::Component( sName )
+		, m_inPort( "Input", *this, boost::bind( &OnlineTipCalibrationComponent::receivePose, this, _1 ) )
+		, m_outPort( "Output", *this )
+		, m_pivotPort( "Pivot", *this )
+		, m_residualPort( "Residual", *this )
+		, m_forgetting( 1.0 )
+		, m_minPoses( 10 )
+		, m_count( 0 )
+		, m_weight( 0.0 )
+		, m_tt( 0.0 )
+	{
+		subgraph->m_DataflowAttributes.getAttributeData( "forgetting", m_forgetting );
+		subgraph->m_DataflowAttributes.getAttributeData( "minPoses", m_minPoses );
+		if ( m_forgetting <= 0.0 || m_forgetting > 1.0 )
+			UBITRACK_THROW( "forgetting must be in ( 0, 1 ]" );
+
+		m_r.setZero();
+		m_rt.setZero();
+		m_t.setZero();
+	}
+
+	/** adds a pose and sends the new estimate */
+	void receivePose( const Measurement::Pose& m )
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+
+		// rotation matrix and translation of the pose
+		FixedMatrix< 3, 3 > r;
+		for ( std::size_t j = 0; j < 3; j++ )
+		{
+			Math::Vector< double, 3 > axis( 0.0, 0.0, 0.0 );
+			axis( j ) = 1.0;
+			Math::Vector< double, 3 > column( m->rotation() * axis );
+			for ( std::size_t i = 0; i < 3; i++ )
+				r( i, j ) = column( i );
+		}
+		const Math::Vector< double, 3 >& t( m->translation() );
+
+		// update the weighted sums
+		m_count++;
+		m_weight = m_forgetting * m_weight + 1.0;
+		m_tt = m_forgetting * m_tt;
+		for ( std::size_t i = 0; i < 3; i++ )
+		{
+			m_tt += t( i ) * t( i );
+			m_t[ i ] = m_forgetting * m_t[ i ] + t( i );
+			m_rt[ i ] = m_forgetting * m_rt[ i ] + r( 0, i ) * t( 0 ) + r( 1, i ) * t( 1 ) + r( 2, i ) * t( 2 );
+			for ( std::size_t j = 0; j < 3; j++ )
+				m_r( i, j ) = m_forgetting * m_r( i, j ) + r( i, j );
+		}
+
+		if ( m_count < m_minPoses || m_count < 3 )
+			return;
+
+		// normal equations of [ R_i, -I ] ( tip, pivot ) = -t_i
+		FixedMatrix< 6, 6 > ata( FixedMatrix< 6, 6 >::zeros() );
+		FixedMatrix< 6, 1 > atb;
+		for ( std::size_t i = 0; i < 3; i++ )
+		{
+			ata( i, i ) = ata( 3 + i, 3 + i ) = m_weight;
+			for ( std::size_t j = 0; j < 3; j++ )
+			{
+				ata( i, 3 + j ) = -m_r( j, i );
+				ata( 3 + i, j ) = -m_r( i, j );
+			}
+			atb[ i ] = -m_rt[ i ];
+			atb[ 3 + i ] = m_t[ i ];
+		}
+
+		// the system is singular until the marker was rotated around two axes
+		FixedMatrix< 6, 6 > chol;
+		if ( !cholesky( ata, chol ) )
+			return;
+		for ( std::size_t i = 0; i < 6; i++ )
+			if ( chol( i, i ) * chol( i, i ) < 1e-6 * m_weight )
+			{
+				LOG4CPP_DEBUG( logger, getName() << ": rotations do not determine the tip yet" );
+				return;
+			}
+
+		FixedMatrix< 6, 1 > x( atb );
+		choleskySolve( chol, x );
+
+		// squared residual: x^T A^T A x - 2 x^T A^T b + b^T b
+		double sse( m_tt );
+		for ( std::size_t i = 0; i < 6; i++ )
+		{
+			double ax( 0.0 );
+			for ( std::size_t j = 0; j < 6; j++ )
+				ax += ata( i, j ) * x[ j ];
+			sse += x[ i ] * ( ax - 2.0 * atb[ i ] );
+		}
+		double rms( std::sqrt( std::max( sse, 0.0 ) / m_weight ) );
+
+		LOG4CPP_DEBUG( logger, getName() << ": tip " << x[ 0 ] << " " << x[ 1 ] << " " << x[ 2 ] << " after " << m_count << " poses, rms " << rms );
+
+		m_outPort.send( Measurement::Position( m.time(), Math::Vector< double, 3 >( x[ 0 ], x[ 1 ], x[ 2 ] ) ) );
+		m_pivotPort.send( Measurement::Position( m.time(), Math::Vector< double, 3 >( x[ 3 ], x[ 4 ], x[ 5 ] ) ) );
+		m_residualPort.send( Measurement::Distance( m.time(), rms ) );
+	}
+
+protected:
+	Dataflow::PushConsumer< Measurement::Pose > m_inPort;
+	Dataflow::PushSupplier< Measurement::Position > m_outPort;
+	Dataflow::PushSupplier< Measurement::Position > m_pivotPort;
+	Dataflow::PushSupplier< Measurement::Distance > m_residualPort;
+
+	/** weight of the previous poses */
+	double m_forgetting;
+
+	/** poses before the first result */
+	std::size_t m_minPoses;
+
+	boost::mutex m_mutex;
+
+	/** number of poses received */
+	std::size_t m_count;
+
+	// weighted sums of 1, R_i, R_i^T t_i, t_i and |t_i|^2
+	double m_weight;
+	FixedMatrix< 3, 3 > m_r;
+	FixedMatrix< 3, 1 > m_rt;
+	FixedMatrix< 3, 1 > m_t;
+	double m_tt;
+};
+
+
+UBITRACK_REGISTER_COMPONENT( Dataflow::ComponentFactory* const cf ) {
+	cf->registerComponent< OnlineTipCalibrationComponent > ( "OnlineTipCalibration" );
+}
+
+} } // namespace Ubitrack::Components
@@ -0,0 +1,449 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#ifndef __UBITRACK_COMPONENTS_PARALLELRANSAC_H_INCLUDED__
+#define __UBITRACK_COMPONENTS_PARALLELRANSAC_H_INCLUDED__
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Multithreaded RANSAC with adaptive termination and PROSAC sampling
+ */
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+
+#include "CounterRandom.h"
+
+namespace Ubitrack { namespace Components {
+
+/** parameters of ParallelRansac */
+struct RansacParameters
+{
+	RansacParameters()
+		: threshold( 0.0 )
+		, setSize( 3 )
+		, minInliers( 3 )
+		, minRuns( 1 )
+		, maxRuns( 100 )
+		, confidence( 0.0 )
+		, threads( 1 )
+		, bProsac( false )
+		, preTest( 0 )
+		, seed( 0 )
+	{}
+
+	/** maximum error of an inlier */
+	double threshold;
+
+	/** number of samples per hypothesis */
+	unsigned setSize;
+
+	/** minimum number of inliers of an accepted hypothesis */
+	unsigned minInliers;
+
+	/** minimum and maximum number of hypotheses */
+	unsigned minRuns;
+	unsigned maxRuns;
+
+	/**
+	 * probability of having drawn at least one all-inlier sample before stopping.
+	 * 0 disables the adaptive termination, then maxRuns hypotheses are evaluated.
+	 */
+	double confidence;
+
+	/** number of threads of the RansacThreadPool, 0 for one per core */
+	unsigned threads;
+
+	/** use PROSAC sampling, assuming the samples are sorted by decreasing quality */
+	bool bProsac;
+
+	/** number of random samples that must all be inliers before a hypothesis is scored, 0 disables the test */
+	unsigned preTest;
+
+	/** seed of the random numbers */
+	boost::uint64_t seed;
+};
+
+
+/**
+ * Threads that run a job together with the calling thread.
+ *
+ * The threads are started once and wait for the next job, so a component that runs a RANSAC for every
+ * trigger keeps its pool as a member instead of creating threads for every computation.
+ */
+class RansacThreadPool
+	: private boost::noncopyable
+{
+public:
+	/** starts threads - 1 threads, 0 for one thread per core */
+	explicit RansacThreadPool( unsigned threads )
+		: m_nThreads( threads ? threads : boost::thread::hardware_concurrency() )
+		, m_generation( 0 )
+		, m_running( 0 )
+		, m_bStop( false )
+	{
+		if ( m_nThreads == 0 )
+			m_nThreads = 1;
+		for ( unsigned i = 1; i < m_nThreads; i++ )
+			m_threads.create_thread( boost::bind( &RansacThreadPool::threadProc, this ) );
+	}
+
+	~RansacThreadPool()
+	{
+		{
+			boost::mutex::scoped_lock l( m_mutex );
+			m_bStop = true;
+		}
+		m_start.notify_all();
+		m_threads.join_all();
+	}
+
+	/** number of threads running a job, including the calling thread */
+	unsigned size() const
+	{ return m_nThreads; }
+
+	/** runs the job on all threads and returns when all of them have finished */
+	void run( const boost::function< void() >& job )
+	{
+		boost::mutex::scoped_lock runLock( m_runMutex );
+		{
+			boost::mutex::scoped_lock l( m_mutex );
+			m_job = job;
+			m_running = m_nThreads - 1;
+			m_generation++;
+		}
+		m_start.notify_all();
+
+		job();
+
+		boost::mutex::scoped_lock l( m_mutex );
+		while ( m_running > 0 )
+			m_done.wait( l );
+		m_job.clear();
+	}
+
+protected:
+	void threadProc()
+	{
+		unsigned long generation( 0 );
+		while ( true )
+		{
+			boost::function< void() > job;
+			{
+				boost::mutex::scoped_lock l( m_mutex );
+				while ( !m_bStop && m_generation == generation )
+					m_start.wait( l );
+				if ( m_bStop )
+					return;
+				generation = m_generation;
+				job = m_job;
+			}
+
+			job();
+
+			boost::mutex::scoped_lock l( m_mutex );
+			if ( --m_running == 0 )
+				m_done.notify_all();
+		}
+	}
+
+	unsigned m_nThreads;
+	boost::thread_group m_threads;
+
+	/** serializes the jobs */
+	boost::mutex m_runMutex;
+
+	// current job, protected by m_mutex
+	boost::mutex m_mutex;
+	boost::condition_variable m_start;
+	boost::condition_variable m_done;
+	boost::function< void() > m_job;
+	unsigned long m_generation;
+	unsigned m_running;
+	bool m_bStop;
+};
+
+
+/**
+ * @ingroup dataflow_components
+ * RANSAC that evaluates its hypotheses on the threads of a RansacThreadPool.
+ *
+ * The problem is described by a class with the following interface, whose const methods must be
+ * safe to call concurrently:
+ * @code
+ * typedef ... result_type;
+ * std::size_t size() const;
+ * bool estimate( result_type& result, const std::vector< std::size_t >& indices ) const;
+ * double error( const result_type& result, std::size_t index ) const;
+ * // errors of the samples begin ... end - 1, at most blockSize of them
+ * void errors( const result_type& result, std::size_t begin, std::size_t end, double* out ) const;
+ * @endcode
+ *
+ * Hypothesis k draws its samples from random stream k, so the samples of a hypothesis do not depend on
+ * the number of threads. Which hypotheses are evaluated does: the threads share the best hypothesis found
+ * so far, and with a confidence it bounds the number of hypotheses as soon as it is found, so the number
+ * of evaluated hypotheses depends on the number of threads and their timing. The scoring of a hypothesis
+ * is aborted once it cannot reach the inliers of the best one, which only drops worse hypotheses. Without a
+ * confidence, all maxRuns hypotheses are evaluated and the result is the same for any number of threads,
+ * except that of two hypotheses with equal inliers and equal error the one finished first is kept.
+ * The pool is owned by the caller, usually the component, and reused for every run. With a confidence,
+ * the number of hypotheses is bounded by log( 1 - confidence ) / log( 1 - w^setSize ), where w is the
+ * inlier ratio of the best hypothesis so far.
+ * With PROSAC (Chum and Matas, "Matching with PROSAC"), hypotheses are drawn from a growing set of the
+ * best samples first, which finds good hypotheses much earlier if the quality order is meaningful.
+ *
+ * Hypotheses are scored in blocks of samples, which allows the problem to evaluate them in a vectorized
+ * way. Scoring stops as soon as a hypothesis cannot beat the best one found so far. With a preTest of d,
+ * hypotheses are rejected unless d random samples are inliers (the T(d,d) test of Matas and Chum,
+ * "Randomized RANSAC with T(d,d) test"). This also rejects some good hypotheses, so it pays off on large
+ * sets of samples and should be combined with a larger maxRuns or the adaptive termination.
+ *
+ * The best hypothesis is refined by estimating the result from all its inliers.
+ */
+template< class Problem >
+class ParallelRansac
+{
+public:
+	typedef typename Problem::result_type ResultType;
+
+	/** number of samples scored at once */
+	static const std::size_t blockSize = 64;
+
+	ParallelRansac( const Problem& problem, const RansacParameters& params, RansacThreadPool& pool )
+		: m_problem( problem )
+		, m_pool( pool )
+		, m_params( params )
+		, m_size( problem.size() )
+		, m_next( 0 )
+		, m_bound( params.maxRuns )
+		, m_evaluated( 0 )
+		, m_bFound( false )
+		, m_bestError( 0.0 )
+	{
+		if ( m_params.bProsac )
+			initProsac();
+	}
+
+	/**
+	 * runs the RANSAC.
+	 * @param result the refined result, undefined if no hypothesis has enough inliers
+	 * @param inliers indices of the inliers of the best hypothesis
+	 * @return the number of evaluated hypotheses
+	 */
+	unsigned run( ResultType& result, std::vector< std::size_t >& inliers )
+	{
+		inliers.clear();
+		if ( m_size < m_params.setSize || m_params.setSize == 0 )
+			return 0;
+
+		m_pool.run( boost::bind( &ParallelRansac< Problem >::worker, this ) );
+
+		if ( m_bFound )
+		{
+			if ( !m_problem.estimate( result, m_bestInliers ) )
+				result = m_bestResult;
+			inliers = m_bestInliers;
+		}
+		return m_evaluated;
+	}
+
+protected:
+	/** evaluates hypotheses until the bound is reached */
+	void worker()
+	{
+		CounterRandom rng;
+		std::vector< std::size_t > sample( m_params.setSize );
+		std::vector< std::size_t > inliers;
+		inliers.reserve( m_size );
+		ResultType hypothesis;
+
+		while ( true )
+		{
+			unsigned k;
+			std::size_t nBest;
+			{
+				boost::mutex::scoped_lock l( m_mutex );
+				if ( m_next >= m_bound )
+					break;
+				k = m_next++;
+				nBest = m_bFound ? m_bestInliers.size() : m_params.minInliers;
+			}
+
+			rng.seed( m_params.seed, k );
+			drawSample( k, rng, sample );
+
+			double error( 0.0 );
+			bool bValid( m_problem.estimate( hypothesis, sample ) && preTest( hypothesis, rng ) &&
+				score( hypothesis, nBest, inliers, error ) );
+
+			boost::mutex::scoped_lock l( m_mutex );
+			m_evaluated++;
+			if ( !bValid || inliers.size() < m_params.minInliers )
+				continue;
+
+			if ( !m_bFound || inliers.size() > m_bestInliers.size() ||
+				( inliers.size() == m_bestInliers.size() && error < m_bestError ) )
+			{
+				m_bFound = true;
+				m_bestResult = hypothesis;
+				m_bestInliers.swap( inliers );
+				m_bestError = error;
+				updateBound();
+			}
+		}
+	}
+
+	/** T(d,d) test, returns true if all of preTest random samples are inliers */
+	bool preTest( const ResultType& hypothesis, CounterRandom& rng ) const
+	{
+		for ( unsigned d = 0; d < m_params.preTest; d++ )
+		{
+			std::size_t i( std::min( std::size_t( rng.uniform01() * m_size ), m_size - 1 ) );
+			if ( !( m_problem.error( hypothesis, i ) < m_params.threshold ) )
+				return false;
+		}
+		return true;
+	}
+
+	/**
+	 * finds the inliers of a hypothesis.
+	 * @return false if the hypothesis was aborted because it cannot get nBest inliers
+	 */
+	bool score( const ResultType& hypothesis, std::size_t nBest, std::vector< std::size_t >& inliers, double& error ) const
+	{
+		inliers.clear();
+		double errors[ blockSize ];
+		for ( std::size_t begin = 0; begin < m_size; begin += blockSize )
+		{
+			std::size_t end( std::min( begin + blockSize, m_size ) );
+			m_problem.errors( hypothesis, begin, end, errors );
+			for ( std::size_t i = begin; i < end; i++ )
+				if ( errors[ i - begin ] < m_params.threshold )
+				{
+					inliers.push_back( i );
+					error += errors[ i - begin ];
+				}
+
+			if ( inliers.size() + ( m_size - end ) < nBest )
+				return false;
+		}
+		return true;
+	}
+
+	/** draws the sample of hypothesis k */
+	void drawSample( unsigned k, CounterRandom& rng, std::vector< std::size_t >& sample ) const
+	{
+		std::size_t n( m_size );
+		std::size_t first( 0 );
+		if ( m_params.bProsac )
+		{
+			// size of the current PROSAC set, whose last element is always used
+			std::size_t j( std::lower_bound( m_prosacLimits.begin(), m_prosacLimits.end(), k + 1 ) - m_prosacLimits.begin() );
+			if ( j < m_prosacLimits.size() )
+			{
+				n = m_params.setSize + j;
+				sample[ 0 ] = n - 1;
+				first = 1;
+				n--;
+			}
+		}
+
+		for ( std::size_t s = first; s < sample.size(); s++ )
+		{
+			bool bDuplicate;
+			do
+			{
+				sample[ s ] = std::min( std::size_t( rng.uniform01() * n ), n - 1 );
+				bDuplicate = std::find( sample.begin(), sample.begin() + s, sample[ s ] ) != sample.begin() + s;
+			}
+			while ( bDuplicate );
+		}
+	}
+
+	/** adapts the number of hypotheses to the inlier ratio, must be called with locked mutex */
+	void updateBound()
+	{
+		if ( m_params.confidence <= 0.0 )
+			return;
+
+		double pGood( std::pow( double( m_bestInliers.size() ) / m_size, double( m_params.setSize ) ) );
+		double bound( m_params.minRuns );
+		if ( pGood < 1.0 )
+			bound = std::ceil( std::log( 1.0 - m_params.confidence ) / std::log( 1.0 - pGood ) );
+
+		m_bound = unsigned( std::max( double( m_params.minRuns ), std::min( bound, double( m_bound ) ) ) );
+	}
+
+	/** computes the PROSAC schedule T'_n for n = setSize ... size */
+	void initProsac()
+	{
+		const std::size_t m( m_params.setSize );
+		if ( m > m_size )
+			return;
+
+		// expected number of hypotheses from the first m samples among maxRuns uniformly drawn ones
+		double tn( m_params.maxRuns );
+		for ( std::size_t i = 0; i < m; i++ )
+			tn *= double( m - i ) / double( m_size - i );
+
+		unsigned tPrime( 1 );
+		m_prosacLimits.push_back( tPrime );
+		for ( std::size_t n = m; n < m_size; n++ )
+		{
+			double tnNext( tn * ( n + 1 ) / ( n + 1 - m ) );
+			tPrime += unsigned( std::ceil( tnNext - tn ) );
+			m_prosacLimits.push_back( tPrime );
+			tn = tnNext;
+		}
+	}
+
+	const Problem& m_problem;
+	RansacThreadPool& m_pool;
+	RansacParameters m_params;
+	std::size_t m_size;
+
+	/** last hypothesis of each PROSAC set size, starting with setSize */
+	std::vector< unsigned > m_prosacLimits;
+
+	// shared state of the workers
+	boost::mutex m_mutex;
+	unsigned m_next;
+	unsigned m_bound;
+	unsigned m_evaluated;
+
+	// best hypothesis so far
+	bool m_bFound;
+	ResultType m_bestResult;
+	std::vector< std::size_t > m_bestInliers;
+	double m_bestError;
+};
+
+} } // namespace Ubitrack::Components
+
+#endif
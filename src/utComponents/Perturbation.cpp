@@ -44,6 +44,8 @@
 #include <boost/random.hpp>
 #include <boost/math/constants/constants.hpp>
 
+#include "CounterRandom.h"
+
 using namespace Ubitrack;
 
 // get a logger
@@ -56,22 +58,15 @@ namespace Ubitrack { namespace Components {
 enum Distribution { GAUSSIAN, UNIFORM };
 
 
-template< class EventType >
-class PerturbationComponent
-	: public Dataflow::TriggerComponent
+/**
+ * Random number generators and perturbation functions shared by the perturbation components.
+ * Reads the attributes "posStdDev", "rotStdDev", "enableNormalize", "distribution", "seed" and "stream".
+ */
+class PerturbationBase
 {
 public:
-	/**
-	 * UTQL component constructor.
-	 *
-	 * @param sName Unique name of the component.
-	 * @param subgraph UTQL subgraph
-	 */
-    PerturbationComponent( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
-		: Dataflow::TriggerComponent( sName, subgraph )
-		, m_inPort( "AB", *this )
-		, m_outPort( "AB-Perturbed", *this )
-		, enableNormalize( false )
+	PerturbationBase( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
+		: enableNormalize( false )
 		, dist ( GAUSSIAN )
 	{
 		double posStdDev( 0.01 );
@@ -89,33 +84,36 @@ public:
 
 		LOG4CPP_DEBUG( logger, "Setup perturbation component " << sName << ". pos. std. dev: " << posStdDev << ", rot. std. dev: " << rotStdDev << ", normalization: " << enableNormalize << ", distribution type: " << distribution );
 
-		/* Simple random number generator. */
-		rng.reset ( new boost::mt19937( (unsigned int )Measurement::now() ) );
+		/*
+		 * Counter-based random number generator, seeded from the clock unless a seed attribute is given
+		 * for reproducible runs. Components with the same seed and different streams draw independent samples,
+		 * without a stream attribute the stream is derived from the component name.
+		 */
+		unsigned long long seed( Measurement::now() );
+		unsigned long long stream( CounterRandom::streamFromName( sName ) );
+		if ( subgraph->m_DataflowAttributes.hasAttribute( "seed" ) )
+			subgraph->m_DataflowAttributes.getAttributeData( "seed", seed );
+		if ( subgraph->m_DataflowAttributes.hasAttribute( "stream" ) )
+			subgraph->m_DataflowAttributes.getAttributeData( "stream", stream );
+		rng.reset ( new CounterRandom( seed, stream ) );
 		
 		/* Position error */
 		distPosNorm.reset ( new boost::normal_distribution<double>( 0.0, posStdDev ) );
-		distSamplerPosNorm.reset ( new boost::variate_generator<boost::mt19937&, boost::normal_distribution<double> >( *rng, *distPosNorm ) );
+		distSamplerPosNorm.reset ( new boost::variate_generator<CounterRandom&, boost::normal_distribution<double> >( *rng, *distPosNorm ) );
 		distPosUni.reset ( new boost::uniform_real<double>( -posStdDev * sqrt(double(3.0) ), posStdDev * sqrt(double(3.0) ) ) );
-		distSamplerPosUni.reset ( new boost::variate_generator<boost::mt19937&, boost::uniform_real<double> >( *rng, *distPosUni ) );
+		distSamplerPosUni.reset ( new boost::variate_generator<CounterRandom&, boost::uniform_real<double> >( *rng, *distPosUni ) );
 
 		/* Direction error */
 		distDir.reset( new boost::uniform_on_sphere<double>( 3 ) );
-		distSamplerDir.reset ( new boost::variate_generator<boost::mt19937&, boost::uniform_on_sphere<double> >( *rng, *distDir ) );
+		distSamplerDir.reset ( new boost::variate_generator<CounterRandom&, boost::uniform_on_sphere<double> >( *rng, *distDir ) );
 
 		/* Angle error */
 		distRotNorm.reset ( new boost::normal_distribution<double>( 0.0, rotStdDev * (boost::math::constants::pi<double>() / 180.0) ) );
-		distSamplerRotNorm.reset ( new boost::variate_generator<boost::mt19937&, boost::normal_distribution<double> >( *rng, *distRotNorm ) );
+		distSamplerRotNorm.reset ( new boost::variate_generator<CounterRandom&, boost::normal_distribution<double> >( *rng, *distRotNorm ) );
 		distRotUni.reset ( new boost::uniform_real<double>( -rotStdDev * sqrt(double(3.0)) * (boost::math::constants::pi<double>() / 180.0), rotStdDev * sqrt(double(3.0)) * (boost::math::constants::pi<double>() / 180.0) ) );
-		distSamplerRotUni.reset ( new boost::variate_generator<boost::mt19937&, boost::uniform_real<double> >( *rng, *distRotUni ) );
+		distSamplerRotUni.reset ( new boost::variate_generator<CounterRandom&, boost::uniform_real<double> >( *rng, *distRotUni ) );
 	}
 
-	/** Method that computes the result. */
-	void compute( Measurement::Timestamp t )
-	{
-		EventType event( t, perturb ( *(m_inPort.get()) ) );
-	    m_outPort.send( event );
-	}	
-
 protected:
 	Math::Vector< double, 2 > perturbPosition2D( Math::Vector< double, 2 > pos ) 
 	{
@@ -175,19 +173,22 @@ protected:
 		return rot;
 	}
 
-	typename EventType::value_type perturb( const typename EventType::value_type& ref );
-	
-	/** Input port of the component. */
-	Dataflow::TriggerInPort< EventType > m_inPort;
-	/** Output port of the component. */
-	Dataflow::TriggerOutPort< EventType > m_outPort;
+	/** Perturbs a single value of the measurement types that can be sampled in batches */
+	//@{
+	Math::Vector< double, 3 > perturbSample( const Math::Vector< double, 3 >& pos )
+	{ return perturbPosition( pos ); }
+
+	Math::Pose perturbSample( const Math::Pose& pose )
+	{ return Math::Pose( perturbOrientation ( pose.rotation() ), perturbPosition ( pose.translation() ) ); }
+	//@}
+
 	/** Shall the perturbed orientation quaternion be normalized? */
 	bool enableNormalize;
 	/** Determines which distribution type to use for random sampling */
 	Distribution dist;
 
 	/** Default random number generator used for all variate generators. */
-	boost::scoped_ptr< boost::mt19937 > rng;
+	boost::scoped_ptr< CounterRandom > rng;
 
 	/** Position error distributions. */
 	//@{
@@ -197,8 +198,8 @@ protected:
 	
 	/** Position variate generators */
 	//@{
-	boost::scoped_ptr< boost::variate_generator<boost::mt19937&, boost::normal_distribution<double> > > distSamplerPosNorm;
-	boost::scoped_ptr< boost::variate_generator<boost::mt19937&, boost::uniform_real<double> > > distSamplerPosUni;
+	boost::scoped_ptr< boost::variate_generator<CounterRandom&, boost::normal_distribution<double> > > distSamplerPosNorm;
+	boost::scoped_ptr< boost::variate_generator<CounterRandom&, boost::uniform_real<double> > > distSamplerPosUni;
 	//@}
 
 	/** Angle error distributions. */
@@ -209,14 +210,104 @@ protected:
 
 	/** Angle variate generators */
 	//@{
-	boost::scoped_ptr< boost::variate_generator<boost::mt19937&, boost::normal_distribution<double> > > distSamplerRotNorm;
-	boost::scoped_ptr< boost::variate_generator<boost::mt19937&, boost::uniform_real<double> > > distSamplerRotUni;
+	boost::scoped_ptr< boost::variate_generator<CounterRandom&, boost::normal_distribution<double> > > distSamplerRotNorm;
+	boost::scoped_ptr< boost::variate_generator<CounterRandom&, boost::uniform_real<double> > > distSamplerRotUni;
 	//@}
 
 	/** Direction uniform error distribution. */
 	boost::scoped_ptr< boost::uniform_on_sphere<double> > distDir;
 	/** Direction random number generator */
-	boost::scoped_ptr< boost::variate_generator<boost::mt19937&, boost::uniform_on_sphere<double> > > distSamplerDir;
+	boost::scoped_ptr< boost::variate_generator<CounterRandom&, boost::uniform_on_sphere<double> > > distSamplerDir;
+};
+
+
+template< class EventType >
+class PerturbationComponent
+	: public Dataflow::TriggerComponent
+	, protected PerturbationBase
+{
+public:
+	/**
+	 * UTQL component constructor.
+	 *
+	 * @param sName Unique name of the component.
+	 * @param subgraph UTQL subgraph
+	 */
+    PerturbationComponent( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
+		: Dataflow::TriggerComponent( sName, subgraph )
+		, PerturbationBase( sName, subgraph )
+		, m_inPort( "AB", *this )
+		, m_outPort( "AB-Perturbed", *this )
+	{
+	}
+
+	/** Method that computes the result. */
+	void compute( Measurement::Timestamp t )
+	{
+		EventType event( t, perturb ( *(m_inPort.get()) ) );
+	    m_outPort.send( event );
+	}	
+
+protected:
+	typename EventType::value_type perturb( const typename EventType::value_type& ref );
+	
+	/** Input port of the component. */
+	Dataflow::TriggerInPort< EventType > m_inPort;
+	/** Output port of the component. */
+	Dataflow::TriggerOutPort< EventType > m_outPort;
+};
+
+
+/**
+ * Perturbation component that draws many samples of the same measurement at once.
+ *
+ * For each input measurement, "size" perturbed samples are generated and sent as one list measurement.
+ * Together with the list covariance estimation components, a complete Monte Carlo estimation takes a
+ * single pass through the dataflow instead of one round trip per sample.
+ */
+template< class EventType, class ListType >
+class BatchPerturbationComponent
+	: public Dataflow::TriggerComponent
+	, protected PerturbationBase
+{
+public:
+	/**
+	 * UTQL component constructor.
+	 *
+	 * @param sName Unique name of the component.
+	 * @param subgraph UTQL subgraph
+	 */
+	BatchPerturbationComponent( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
+		: Dataflow::TriggerComponent( sName, subgraph )
+		, PerturbationBase( sName, subgraph )
+		, m_inPort( "AB", *this )
+		, m_outPort( "AB-Perturbed", *this )
+		, m_size( 100 )
+	{
+		subgraph->m_DataflowAttributes.getAttributeData( "size", m_size );
+	}
+
+	/** Method that computes the result. */
+	void compute( Measurement::Timestamp t )
+	{
+		const typename EventType::value_type& ref( *m_inPort.get() );
+
+		boost::shared_ptr< typename ListType::value_type > pSamples( new typename ListType::value_type( m_size ) );
+		for ( std::size_t i = 0; i < m_size; i++ )
+			( *pSamples )[ i ] = perturbSample( ref );
+
+		LOG4CPP_TRACE( logger, getName() << ": generated " << m_size << " perturbed samples" );
+		m_outPort.send( ListType( t, pSamples ) );
+	}
+
+protected:
+	/** Input port of the component. */
+	Dataflow::TriggerInPort< EventType > m_inPort;
+	/** Output port of the component. */
+	Dataflow::TriggerOutPort< ListType > m_outPort;
+
+	/** number of samples per input measurement */
+	std::size_t m_size;
 };
 
 
@@ -302,6 +393,8 @@ UBITRACK_REGISTER_COMPONENT( Dataflow::ComponentFactory* const cf ) {
 	cf->registerComponent< PerturbationComponent< Measurement::Rotation      > > ( "RotationPerturbation" );
 	cf->registerComponent< PerturbationComponent< Measurement::Pose          > > ( "PosePerturbation" );
 	cf->registerComponent< PerturbationComponent< Measurement::PoseList      > > ( "PoseListPerturbation" );
+	cf->registerComponent< BatchPerturbationComponent< Measurement::Position, Measurement::PositionList > > ( "3DPositionBatchPerturbation" );
+	cf->registerComponent< BatchPerturbationComponent< Measurement::Pose,     Measurement::PoseList     > > ( "PoseBatchPerturbation" );
 }
 
 } } // namespace Ubitrack::Components
@@ -0,0 +1,330 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Sampler that is phase-locked to an external clock
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <log4cpp/Category.hh>
+
+#include <utDataflow/Component.h>
+#include <utDataflow/PullConsumer.h>
+#include <utDataflow/PushConsumer.h>
+#include <utDataflow/PushSupplier.h>
+#include <utDataflow/ComponentFactory.h>
+#include <utMeasurement/Measurement.h>
+#include <utUtil/Exception.h>
+
+// get a logger
+static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Components.PhaseLockedSampler" ) );
+static log4cpp::Category& eventLogger( log4cpp::Category::getInstance( "Ubitrack.Events.Components.PhaseLockedSampler" ) );
+
+namespace Ubitrack { namespace Components {
+
+/**
+ * @ingroup dataflow_components
+ * Sampler that learns period and phase of an external clock and pulls its input at the predicted ticks.
+ *
+ * A typical clock is a button event sent by the frame callback of a renderer. The component
+ * runs a phase-locked loop on the trigger timestamps and wakes up \c lead seconds before each
+ * predicted tick to pull the input for the predicted tick time plus \c offset, e.g. the display
+ * time of the frame.
+ *
+ * @par Input Ports
+ * PushConsumer< Measurement::Button > with name "Trigger".
+ * PullConsumer< EventType > with name "Input".
+ *
+ * @par Output Ports
+ * PushSupplier< EventType > with name "Output".
+ *
+ * @par Configuration
+ * @verbatim <Configuration offset="0.016" lead="0.002" phaseGain="0.1" periodGain="0.01" lockThreshold="0.25"/> @endverbatim
+ * \c offset: seconds added to the predicted tick time to get the query time, e.g. the display latency
+ * \c lead: seconds before the predicted tick at which the input is pulled
+ * \c phaseGain: fraction of the phase error that is corrected with each trigger, in ( 0, 1 )
+ * \c periodGain: fraction of the phase error that is used to correct the period, in ( 0, 1 )
+ * \c lockThreshold: phase error relative to the period above which a trigger counts as not matching.
+ *   After three non-matching triggers in a row the loop is reset.
+ *
+ * @par Operation
+ * Samples are only generated while the loop is locked, i.e. after at least two triggers were received.
+ * Missed triggers are detected and do not disturb the estimate.
+ *
+ * @par Instances
+ * Registered for Pose, ErrorPose, Rotation and Position.
+ */
+template< class EventType >
+class PhaseLockedSampler
+	: public Dataflow::Component
+{
+public:
+	/**
+	 * UTQL component constructor.
+	 *
+	 * @param sName Unique name of the component.
+	 * @param subgraph UTQL subgraph
+	 */
+	PhaseLockedSampler( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
+		: Dataflow::Component( sName )
+		, m_triggerPort( "Trigger", *this, boost::bind( &PhaseLockedSampler< EventType >::receiveTrigger, this, _1 ) )
+		, m_inPort( "Input", *this )
+		, m_outPort( "Output", *this )
+		, m_nOffset( 0 )
+		, m_nLead( 2000000 )
+		, m_phaseGain( 0.1 )
+		, m_periodGain( 0.01 )
+		, m_lockThreshold( 0.25 )
+		, m_bStop( true )
+	{
+		double offset( 0 );
+		subgraph->m_DataflowAttributes.getAttributeData( "offset", offset );
+		m_nOffset = (long long int)( 1e9 * offset );
+
+		double lead( 0.002 );
+		subgraph->m_DataflowAttributes.getAttributeData( "lead", lead );
+		m_nLead = (long long int)( 1e9 * lead );
+
+		subgraph->m_DataflowAttributes.getAttributeData( "phaseGain", m_phaseGain );
+		subgraph->m_DataflowAttributes.getAttributeData( "periodGain", m_periodGain );
+		if ( m_phaseGain <= 0.0 || m_phaseGain >= 1.0 )
+			UBITRACK_THROW( "phaseGain must be in ( 0, 1 )" );
+		if ( m_periodGain <= 0.0 || m_periodGain >= 1.0 )
+			UBITRACK_THROW( "periodGain must be in ( 0, 1 )" );
+		subgraph->m_DataflowAttributes.getAttributeData( "lockThreshold", m_lockThreshold );
+
+		reset();
+	}
+
+	~PhaseLockedSampler()
+	{
+		stop();
+	}
+
+	/** component start method, starts thread */
+	virtual void start()
+	{
+		if ( !m_running )
+		{
+			m_running = true;
+			m_bStop = false;
+			m_pThread.reset( new boost::thread( boost::bind( &PhaseLockedSampler< EventType >::threadMethod, this ) ) );
+		}
+	}
+
+	/** component stop method, stops thread */
+	virtual void stop()
+	{
+		if ( m_running )
+		{
+			m_running = false;
+			{
+				boost::mutex::scoped_lock l( m_mutex );
+				m_bStop = true;
+				m_wakeup.notify_all();
+			}
+			if ( m_pThread )
+				m_pThread->join();
+		}
+	}
+
+protected:
+	/** updates the phase-locked loop with a new clock tick */
+	void receiveTrigger( const Measurement::Button& b );
+
+	/** resets the loop to the unlocked state */
+	void reset()
+	{
+		m_nTriggers = 0;
+		m_nMisses = 0;
+		m_period = 0;
+		m_phase = 0;
+	}
+
+	/** Method that samples the input at the predicted ticks */
+	void threadMethod();
+
+	/** Ports of the component */
+	Dataflow::PushConsumer< Measurement::Button > m_triggerPort;
+	Dataflow::PullConsumer< EventType > m_inPort;
+	Dataflow::PushSupplier< EventType > m_outPort;
+
+	/** offset to add to the predicted tick for the query time */
+	long long int m_nOffset;
+
+	/** time before the predicted tick at which the input is pulled */
+	long long int m_nLead;
+
+	/** loop gains */
+	double m_phaseGain;
+	double m_periodGain;
+
+	/** relative phase error above which a trigger is considered not to match */
+	double m_lockThreshold;
+
+	/** number of triggers since the last reset */
+	int m_nTriggers;
+
+	/** number of consecutive non-matching triggers */
+	int m_nMisses;
+
+	/** estimated period in ns */
+	double m_period;
+
+	/** estimated time of the last tick */
+	Measurement::Timestamp m_phase;
+
+	/** protects the loop state */
+	boost::mutex m_mutex;
+
+	/** signals new loop state and stop requests */
+	boost::condition_variable m_wakeup;
+
+	/** stop? */
+	bool m_bStop;
+
+	/** pointer to the thread */
+	boost::scoped_ptr< boost::thread > m_pThread;
+};
+
+
+template< class EventType >
+void PhaseLockedSampler< EventType >::receiveTrigger( const Measurement::Button& b )
+{
+	boost::mutex::scoped_lock l( m_mutex );
+	Measurement::Timestamp t = b.time();
+
+	if ( m_nTriggers == 0 || ( m_nTriggers == 1 && t <= m_phase ) )
+	{
+		// first trigger
+		m_nTriggers = 1;
+		m_phase = t;
+		return;
+	}
+
+	if ( t <= m_phase )
+		return; // duplicate or out-of-order trigger
+
+	if ( m_nTriggers == 1 )
+	{
+		// initial period estimate
+		m_period = double( t - m_phase );
+		m_phase = t;
+		m_nTriggers++;
+		m_wakeup.notify_all();
+		return;
+	}
+
+	// number of periods since the last tick, more than one if triggers were missed
+	double elapsed = double( t - m_phase );
+	double nPeriods = std::max( 1.0, std::floor( elapsed / m_period + 0.5 ) );
+	double error = elapsed - nPeriods * m_period;
+
+	if ( std::fabs( error ) > m_lockThreshold * m_period )
+	{
+		if ( ++m_nMisses >= 3 )
+		{
+			LOG4CPP_INFO( logger, getName() << ": lost lock to external clock, resetting" );
+			reset();
+			m_nTriggers = 1;
+			m_phase = t;
+		}
+		return;
+	}
+	m_nMisses = 0;
+
+	// PLL update of phase and period
+	m_phase += Measurement::Timestamp( nPeriods * m_period + m_phaseGain * error );
+	m_period += m_periodGain * error / nPeriods;
+	m_nTriggers++;
+
+	LOG4CPP_TRACE( eventLogger, getName() << ": phase error " << error * 1e-6 << "ms, period " << m_period * 1e-6 << "ms" );
+	m_wakeup.notify_all();
+}
+
+
+template< class EventType >
+void PhaseLockedSampler< EventType >::threadMethod()
+{
+	Measurement::Timestamp lastTick( 0 );
+
+	boost::mutex::scoped_lock l( m_mutex );
+	while ( !m_bStop )
+	{
+		if ( m_nTriggers < 2 )
+		{
+			// not locked yet
+			m_wakeup.wait( l );
+			continue;
+		}
+
+		// predict the next tick that has not been sampled yet and is at least lead time ahead
+		Measurement::Timestamp now = Measurement::now();
+		Measurement::Timestamp earliest = std::max( now + m_nLead, lastTick + Measurement::Timestamp( m_period / 2 ) );
+		double k = earliest > m_phase ? std::ceil( double( earliest - m_phase ) / m_period ) : 1.0;
+		Measurement::Timestamp tick = m_phase + Measurement::Timestamp( k * m_period );
+		Measurement::Timestamp wakeup = tick - m_nLead;
+
+		if ( now < wakeup )
+		{
+			// sleep, the prediction may change in the meantime
+			m_wakeup.timed_wait( l, boost::get_system_time() + boost::posix_time::microseconds( ( wakeup - now ) / 1000 ) );
+			if ( Measurement::now() < wakeup )
+				continue;
+		}
+
+		lastTick = tick;
+		l.unlock();
+		try
+		{
+			m_outPort.send( m_inPort.get( tick + m_nOffset ) );
+		}
+		catch ( const Util::Exception& e )
+		{
+			LOG4CPP_WARN( eventLogger, "Got exception: " << e );
+		}
+		catch ( const std::exception& e )
+		{
+			LOG4CPP_WARN( eventLogger, "Got unknown exception: " << e.what() );
+		}
+		l.lock();
+	}
+}
+
+
+UBITRACK_REGISTER_COMPONENT( Ubitrack::Dataflow::ComponentFactory* const cf ) {
+	cf->registerComponent< PhaseLockedSampler< Measurement::Pose > > ( "PosePhaseLockedSampler" );
+	cf->registerComponent< PhaseLockedSampler< Measurement::ErrorPose > > ( "ErrorPosePhaseLockedSampler" );
+	cf->registerComponent< PhaseLockedSampler< Measurement::Rotation > > ( "RotationPhaseLockedSampler" );
+	cf->registerComponent< PhaseLockedSampler< Measurement::Position > > ( "PositionPhaseLockedSampler" );
+}
+
+} } // namespace Ubitrack::Components
@@ -0,0 +1,134 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#ifndef __UBITRACK_COMPONENTS_POSEFILTER_H_INCLUDED__
+#define __UBITRACK_COMPONENTS_POSEFILTER_H_INCLUDED__
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Common interface of the pose kalman filter implementations
+ */
+
+#include <ostream>
+#include <utMeasurement/Measurement.h>
+
+namespace Ubitrack { namespace Components {
+
+/**
+ * @ingroup dataflow_components
+ * Interface of the pose filters used by the PoseKalmanFilter component.
+ */
+class PoseFilter
+{
+public:
+	virtual ~PoseFilter()
+	{}
+
+	virtual void addPoseMeasurement( const Measurement::ErrorPose& m ) = 0;
+	virtual void addRotationMeasurement( const Measurement::Rotation& m ) = 0;
+	virtual void addRotationVelocityMeasurement( const Measurement::RotationVelocity& m ) = 0;
+	virtual void addInverseRotationVelocityMeasurement( const Measurement::RotationVelocity& m ) = 0;
+
+	/** predicts the pose at time t */
+	virtual Measurement::ErrorPose predictPose( Measurement::Timestamp t ) = 0;
+
+	/** prints state and covariance */
+	virtual void printState( std::ostream& s ) const = 0;
+
+	/**
+	 * innovation norm and normalized innovation squared of the last measurement update.
+	 * @return false if the filter does not provide them
+	 */
+	virtual bool getUpdateStatistics( double& innovation, double& nis ) const = 0;
+
+	/** returns a copy of the filter */
+	virtual PoseFilter* clone() const = 0;
+
+	/** sets the state to that of another filter of the same type, without allocating */
+	virtual void assign( const PoseFilter& f ) = 0;
+};
+
+
+inline std::ostream& operator<<( std::ostream& s, const PoseFilter& f )
+{
+	f.printState( s );
+	return s;
+}
+
+
+/** default for filters without update statistics, overloaded for filters that provide them */
+template< class Filter >
+bool filterUpdateStatistics( const Filter&, double&, double& )
+{
+	return false;
+}
+
+
+/**
+ * @ingroup dataflow_components
+ * Implements the PoseFilter interface for any class with the methods of Tracking::PoseKalmanFilter.
+ */
+template< class Filter >
+class PoseFilterAdapter
+	: public PoseFilter
+{
+public:
+	PoseFilterAdapter( const Filter& filter )
+		: m_filter( filter )
+	{}
+
+	virtual void addPoseMeasurement( const Measurement::ErrorPose& m )
+	{ m_filter.addPoseMeasurement( m ); }
+
+	virtual void addRotationMeasurement( const Measurement::Rotation& m )
+	{ m_filter.addRotationMeasurement( m ); }
+
+	virtual void addRotationVelocityMeasurement( const Measurement::RotationVelocity& m )
+	{ m_filter.addRotationVelocityMeasurement( m ); }
+
+	virtual void addInverseRotationVelocityMeasurement( const Measurement::RotationVelocity& m )
+	{ m_filter.addInverseRotationVelocityMeasurement( m ); }
+
+	virtual Measurement::ErrorPose predictPose( Measurement::Timestamp t )
+	{ return m_filter.predictPose( t ); }
+
+	virtual void printState( std::ostream& s ) const
+	{ s << m_filter.getState() << std::endl << m_filter.getCovariance(); }
+
+	virtual bool getUpdateStatistics( double& innovation, double& nis ) const
+	{ return filterUpdateStatistics( m_filter, innovation, nis ); }
+
+	virtual PoseFilter* clone() const
+	{ return new PoseFilterAdapter< Filter >( m_filter ); }
+
+	virtual void assign( const PoseFilter& f )
+	{ m_filter = static_cast< const PoseFilterAdapter< Filter >& >( f ).m_filter; }
+
+protected:
+	Filter m_filter;
+};
+
+} } // namespace Ubitrack::Components
+
+#endif
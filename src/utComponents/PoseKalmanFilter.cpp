@@ -35,6 +35,8 @@
 #include <log4cpp/Category.hh>
 #include <boost/numeric/ublas/io.hpp>
 #include <sstream>
+#include <deque>
+#include <algorithm>
 
 #include <utDataflow/Component.h>
 #include <utDataflow/PushConsumer.h>
@@ -44,6 +46,11 @@
 #include <utMeasurement/Measurement.h>
 #include <utTracking/PoseKalmanFilter.h>
 
+#include "PoseFilter.h"
+#include "FilterTelemetry.h"
+#include "FixedPoseKalmanFilter.h"
+#include "PredictionCache.h"
+
 // get a logger
 static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Events.Components.PoseKalmanFilter" ) );
 
@@ -59,6 +66,8 @@ namespace Ubitrack { namespace Components {
  * - PushConsumer< RotationVelocity > with name "InRotationVelocity".
  * - PushConsumer< RotationVelocity > with name "InInverseRotationVelocity".
  *
+ * - PushConsumer< Button > with name "DumpTelemetry" (optional).
+ *
  * Note: Additional input ports can be generated using arbitrary edge names 
  * starting with "InPose", "InRotation", ...
  *
@@ -69,10 +78,44 @@ namespace Ubitrack { namespace Components {
  * - DataflowConfiguration Attribute "posPN": sequence of floats
  * - DataflowConfiguration Attribute "oriPN": sequence of floats
  * - DataflowConfiguration Attribute "insideOut": "true"/"false"
+ * - DataflowConfiguration Attribute "fixedSize": "true"/"false", use the fixed-size filter implementation
+ *   if it supports the motion model, i.e. outside-in with one or two position values and two or three
+ *   orientation values. Otherwise, a warning is logged and the generic filter is used.
+ * - DataflowConfiguration Attribute "telemetry": number of filter updates for which statistics are kept, default 0
+ * - DataflowConfiguration Attribute "history": time in ms for which measurements are kept to integrate late
+ *   measurements at their timestamp, default 0
+ * - DataflowConfiguration Attribute "adaptiveNoise": number of updates over which process and measurement noise
+ *   are estimated, 0 (default) for constant noise. Requires the fixed-size filter.
+ * - DataflowConfiguration Attribute "adaptiveNoiseMin"/"adaptiveNoiseMax": bounds of the estimated noise scale
+ *   factors, default 0.1 and 10
+ * - DataflowConfiguration Attribute "rotationNoise": standard deviation in radians of rotation measurements, default 0.01.
+ *   Requires the fixed-size filter.
+ * - DataflowConfiguration Attribute "rotationVelocityNoise": standard deviation in radians per second of each rotation
+ *   velocity component, default 0.1. Requires the fixed-size filter.
  *
  * @par Operation
  * integrates absolute and relative measurements. relative measurements must be calibrated before!
  * Make sure timestamps are reasonably correct!
+ *
+ * If telemetry is enabled, innovation, normalized innovation squared (fixed-size filter only), measurement age
+ * and update duration of each update are recorded in a ring buffer. An event on "DumpTelemetry" logs the filter
+ * state and the recorded statistics with priority INFO.
+ *
+ * If a history is configured, the component keeps the measurements of that time span together with the filter
+ * state before each of them. A measurement that is older than the newest one is integrated by restoring the
+ * state before the first newer measurement, integrating the late measurement and replaying the newer ones.
+ * Measurements older than the history are integrated at the current filter time, like without a history.
+ *
+ * With adaptive noise, the process noise given by posPN/oriPN and the covariance of pose measurements are
+ * multiplied by scale factors that are estimated from the innovations by covariance matching, see
+ * FixedPoseKalmanFilter. posPN/oriPN then only need to have the right proportions.
+ *
+ * When the fixed-size filter is selected, it is run together with the generic filter on a sequence of static pose
+ * measurements. If the predicted covariances differ by more than one percent, a warning is logged, as the process
+ * noise of the two implementations does not match for this motion model.
+ *
+ * The last few predicted poses are cached until the next update, so several consumers pulling the same
+ * timestamp get the same result without repeating the prediction.
  */
 class PoseKalmanFilterComponent
 	: public Dataflow::Component
@@ -88,28 +131,42 @@ public:
 		: Dataflow::Component( sName )
 		, m_out( "OutPose", *this, boost::bind( &PoseKalmanFilterComponent::sendOut, this, _1 ) )
 		, m_outPush( "OutPosePush", *this )
+		, m_updateInnovation( -1.0 )
+		, m_updateNis( -1.0 )
+		, m_historyTime( 0 )
     {
+		std::size_t telemetrySize( 0 );
+		subgraph->m_DataflowAttributes.getAttributeData( "telemetry", telemetrySize );
+		m_telemetry = FilterTelemetry( telemetrySize );
+
+		double history( 0 );
+		subgraph->m_DataflowAttributes.getAttributeData( "history", history );
+		m_historyTime = Measurement::Timestamp( history * 1e6 ); //ms to ns
+
 		// dynamically generate input ports
 		for ( Graph::UTQLSubgraph::EdgeMap::iterator it = subgraph->m_Edges.begin(); it != subgraph->m_Edges.end(); it++ ) 
 		{
 			if ( it->second->isInput() ) 
 			{
-				if ( 0 == it->first.compare( 0, 6, "InPose" ) )
+				if ( it->first == "DumpTelemetry" )
+					m_pDumpPort.reset( new Dataflow::PushConsumer< Measurement::Button >( it->first, *this, 
+						boost::bind( &PoseKalmanFilterComponent::receiveDump, this, _1 ) ) );
+				else if ( 0 == it->first.compare( 0, 6, "InPose" ) )
 					m_inPosePorts.push_back( boost::shared_ptr< Dataflow::PushConsumer< Measurement::ErrorPose > >( 
 						new Dataflow::PushConsumer< Measurement::ErrorPose >( it->first, *this, 
-							boost::bind( &PoseKalmanFilterComponent::receivePose, this, _1 ) ) ) );
+							boost::bind( &PoseKalmanFilterComponent::receivePose, this, _1, m_telemetry.addPort( it->first ) ) ) ) );
 				else if ( 0 == it->first.compare( 0, 18, "InRotationVelocity" ) )
 					m_inRotationVelocityPorts.push_back( boost::shared_ptr< Dataflow::PushConsumer< Measurement::RotationVelocity > >( 
 						new Dataflow::PushConsumer< Measurement::RotationVelocity >( it->first, *this, 
-							boost::bind( &PoseKalmanFilterComponent::receiveRotationVelocity, this, _1 ) ) ) );
+							boost::bind( &PoseKalmanFilterComponent::receiveRotationVelocity, this, _1, m_telemetry.addPort( it->first ) ) ) ) );
 				else if ( 0 == it->first.compare( 0, 10, "InRotation" ) )
 					m_inRotationPorts.push_back( boost::shared_ptr< Dataflow::PushConsumer< Measurement::Rotation > >( 
 						new Dataflow::PushConsumer< Measurement::Rotation >( it->first, *this, 
-							boost::bind( &PoseKalmanFilterComponent::receiveRotation, this, _1 ) ) ) );
+							boost::bind( &PoseKalmanFilterComponent::receiveRotation, this, _1, m_telemetry.addPort( it->first ) ) ) ) );
 				else if ( 0 == it->first.compare( 0, 25, "InInverseRotationVelocity" ) )
 					m_inInverseRotationVelocityPorts.push_back( boost::shared_ptr< Dataflow::PushConsumer< Measurement::RotationVelocity > >( 
 						new Dataflow::PushConsumer< Measurement::RotationVelocity >( it->first, *this, 
-							boost::bind( &PoseKalmanFilterComponent::receiveInverseRotationVelocity, this, _1 ) ) ) );
+							boost::bind( &PoseKalmanFilterComponent::receiveInverseRotationVelocity, this, _1, m_telemetry.addPort( it->first ) ) ) ) );
 			}
 		}
 	
@@ -145,6 +202,20 @@ public:
 
 		bool bInsideOut = subgraph->m_DataflowAttributes.getAttributeString( "insideOut" ) == "true";
 
+		// online noise estimation
+		std::size_t adaptiveWindow( 0 );
+		double adaptiveMin( 0.1 );
+		double adaptiveMax( 10.0 );
+		subgraph->m_DataflowAttributes.getAttributeData( "adaptiveNoise", adaptiveWindow );
+		subgraph->m_DataflowAttributes.getAttributeData( "adaptiveNoiseMin", adaptiveMin );
+		subgraph->m_DataflowAttributes.getAttributeData( "adaptiveNoiseMax", adaptiveMax );
+
+		// noise of measurements without covariance
+		double rotationNoise( 0.01 );
+		double velocityNoise( 0.1 );
+		subgraph->m_DataflowAttributes.getAttributeData( "rotationNoise", rotationNoise );
+		subgraph->m_DataflowAttributes.getAttributeData( "rotationVelocityNoise", velocityNoise );
+
 		// create the motion model
 		Tracking::LinearPoseMotionModel motionModel( posPN.size() - 1, oriPN.size() - 1 );
 		for ( std::size_t i( 0 ); i < posPN.size(); i++ )
@@ -152,72 +223,254 @@ public:
 		for ( std::size_t i( 0 ); i < oriPN.size(); i++ )
 			motionModel.setOriPN( i, oriPN[ i ] );
 
+		// use the allocation-free implementation for common motion models
+		if ( subgraph->m_DataflowAttributes.getAttributeString( "fixedSize" ) == "true" )
+		{
+			if ( !bInsideOut )
+				m_pKF.reset( createFixedFilter( posPN, oriPN, adaptiveWindow, adaptiveMin, adaptiveMax, rotationNoise, velocityNoise ) );
+			if ( m_pKF )
+				return;
+			LOG4CPP_WARN( logger, getName() << ": no fixed-size filter for this motion model, using the generic filter" );
+		}
+
+		if ( adaptiveWindow )
+			LOG4CPP_WARN( logger, getName() << ": adaptive noise requires the fixed-size filter, using constant noise" );
+
 		// initialize kalman filter with motion model
-		m_pKF.reset( new Tracking::PoseKalmanFilter( motionModel, bInsideOut ) );
+		m_pKF.reset( new PoseFilterAdapter< Tracking::PoseKalmanFilter >( Tracking::PoseKalmanFilter( motionModel, bInsideOut ) ) );
     }
 
 	/** integrates a pose measurement. */
-	void receivePose( const Measurement::ErrorPose& m )
+	void receivePose( const Measurement::ErrorPose& m, std::size_t port )
 	{
 		LOG4CPP_DEBUG( logger, "Received pose measurement: " << m );
-		LOG4CPP_TRACE( logger, "state before: " << m_pKF->getState() << std::endl << m_pKF->getCovariance() );
-
-		m_pKF->addPoseMeasurement( m );
-
-		checkSend( m.time() );
 
-		LOG4CPP_TRACE( logger, "state after: " << m_pKF->getState() << std::endl << m_pKF->getCovariance() );
+		HistoryEntry e( m.time(), poseMeasurement );
+		e.pose = m;
+		integrate( e, port );
     }
 
 	/** integrates a rotation measurement. */
-	void receiveRotation( const Measurement::Rotation& m )
+	void receiveRotation( const Measurement::Rotation& m, std::size_t port )
 	{
 		LOG4CPP_DEBUG( logger, "Received rotation measurement: " << m );
-		LOG4CPP_TRACE( logger, "state before: " << m_pKF->getState() << std::endl << m_pKF->getCovariance() );
 
-		m_pKF->addRotationMeasurement( m );
-
-		checkSend( m.time() );
-
-		LOG4CPP_TRACE( logger, "state after: " << m_pKF->getState() << std::endl << m_pKF->getCovariance() );
+		HistoryEntry e( m.time(), rotationMeasurement );
+		e.rotation = m;
+		integrate( e, port );
     }
 
 	/** integrates a rotation velocity measurement. */
-	void receiveRotationVelocity( const Measurement::RotationVelocity& m )
+	void receiveRotationVelocity( const Measurement::RotationVelocity& m, std::size_t port )
 	{
 		LOG4CPP_DEBUG( logger, "Received rotation velocity measurement: " << m );
-		LOG4CPP_TRACE( logger, "state before: " << m_pKF->getState() << std::endl << m_pKF->getCovariance() );
-
-		m_pKF->addRotationVelocityMeasurement( m );
 
-		checkSend( m.time() );
-
-		LOG4CPP_TRACE( logger, "state after: " << m_pKF->getState() << std::endl << m_pKF->getCovariance() );
+		HistoryEntry e( m.time(), rotationVelocityMeasurement );
+		e.velocity = m;
+		integrate( e, port );
     }
 
 	/** integrates an inverse rotation velocity measurement. */
-	void receiveInverseRotationVelocity( const Measurement::RotationVelocity& m )
+	void receiveInverseRotationVelocity( const Measurement::RotationVelocity& m, std::size_t port )
 	{
 		LOG4CPP_DEBUG( logger, "Received inverse rotation velocity measurement: " << m );
-		LOG4CPP_TRACE( logger, "state before: " << m_pKF->getState() << std::endl << m_pKF->getCovariance() );
-
-		m_pKF->addInverseRotationVelocityMeasurement( m );
 
-		checkSend( m.time() );
-
-		LOG4CPP_TRACE( logger, "state after: " << m_pKF->getState() << std::endl << m_pKF->getCovariance() );
+		HistoryEntry e( m.time(), inverseRotationVelocityMeasurement );
+		e.velocity = m;
+		integrate( e, port );
     }
 
 	/** Method that returns a predicted measurement. */
 	Measurement::ErrorPose sendOut( Measurement::Timestamp t )
 	{
 		LOG4CPP_DEBUG( logger, "Computing pose for t=" << t );
-		LOG4CPP_TRACE( logger, "state: " << m_pKF->getState() << std::endl << m_pKF->getCovariance() );
 
-		return m_pKF->predictPose( t );
+		return predict( t );
 	}
 
 protected:
+	/** creates a fixed-size filter for the motion model, 0 if there is none */
+	static PoseFilter* createFixedFilter( const std::vector< double >& posPN, const std::vector< double >& oriPN,
+		std::size_t adaptiveWindow, double adaptiveMin, double adaptiveMax, double rotationNoise, double velocityNoise )
+	{
+		if ( posPN.size() == 1 && oriPN.size() == 2 )
+			return createFixedFilter< 0, 1 >( posPN, oriPN, adaptiveWindow, adaptiveMin, adaptiveMax, rotationNoise, velocityNoise );
+		else if ( posPN.size() == 2 && oriPN.size() == 2 )
+			return createFixedFilter< 1, 1 >( posPN, oriPN, adaptiveWindow, adaptiveMin, adaptiveMax, rotationNoise, velocityNoise );
+		else if ( posPN.size() == 2 && oriPN.size() == 3 )
+			return createFixedFilter< 1, 2 >( posPN, oriPN, adaptiveWindow, adaptiveMin, adaptiveMax, rotationNoise, velocityNoise );
+		return 0;
+	}
+
+	/** creates a fixed-size filter, optionally with adaptive noise */
+	template< std::size_t PosOrder, std::size_t OriOrder >
+	static PoseFilter* createFixedFilter( const std::vector< double >& posPN, const std::vector< double >& oriPN,
+		std::size_t adaptiveWindow, double adaptiveMin, double adaptiveMax, double rotationNoise, double velocityNoise )
+	{
+		FixedPoseKalmanFilter< PosOrder, OriOrder > filter( posPN, oriPN );
+		filter.setMeasurementNoise( rotationNoise, velocityNoise );
+		if ( adaptiveWindow )
+			filter.setAdaptiveNoise( adaptiveWindow, adaptiveMin, adaptiveMax );
+		return new PoseFilterAdapter< FixedPoseKalmanFilter< PosOrder, OriOrder > >( filter );
+	}
+
+	enum MeasurementType { poseMeasurement, rotationMeasurement, rotationVelocityMeasurement, inverseRotationVelocityMeasurement };
+
+	/** a measurement and the filter state before it was integrated */
+	struct HistoryEntry
+	{
+		HistoryEntry( Measurement::Timestamp t, MeasurementType type_ )
+			: time( t )
+			, type( type_ )
+		{}
+
+		Measurement::Timestamp time;
+		MeasurementType type;
+
+		// only the member corresponding to the type is set
+		Measurement::ErrorPose pose;
+		Measurement::Rotation rotation;
+		Measurement::RotationVelocity velocity;
+
+		boost::shared_ptr< PoseFilter > pStateBefore;
+	};
+
+	/** integrates a new measurement, records telemetry and sends the result */
+	void integrate( HistoryEntry& e, std::size_t port )
+	{
+		Measurement::Timestamp start( m_telemetry.enabled() ? Measurement::now() : 0 );
+
+		if ( m_historyTime )
+			integrateWithHistory( e );
+		else
+			apply( e );
+		m_predictions.invalidate();
+
+		if ( m_telemetry.enabled() )
+		{
+			FilterTelemetryRecord r;
+			r.time = e.time;
+			r.port = port;
+			r.age = 1e-6 * ( double( start ) - double( e.time ) );
+			r.duration = 1e-6 * double( Measurement::now() - start );
+			r.innovation = m_updateInnovation;
+			r.nis = m_updateNis;
+			m_telemetry.add( r );
+		}
+
+		// with a history, the filter state is at the newest measurement time
+		checkSend( m_historyTime && !m_history.empty() ? std::max( e.time, m_history.back().time ) : e.time );
+	}
+
+	/** integrates a measurement into the filter, keeping the update statistics if telemetry is enabled */
+	void apply( const HistoryEntry& e )
+	{
+		switch ( e.type )
+		{
+		case poseMeasurement:
+			m_pKF->addPoseMeasurement( e.pose );
+			break;
+		case rotationMeasurement:
+			m_pKF->addRotationMeasurement( e.rotation );
+			break;
+		case rotationVelocityMeasurement:
+			m_pKF->addRotationVelocityMeasurement( e.velocity );
+			break;
+		case inverseRotationVelocityMeasurement:
+			m_pKF->addInverseRotationVelocityMeasurement( e.velocity );
+			break;
+		}
+
+		if ( m_telemetry.enabled() && !m_pKF->getUpdateStatistics( m_updateInnovation, m_updateNis ) )
+			m_updateInnovation = m_updateNis = -1.0;
+	}
+
+	/** integrates a measurement at its timestamp, replaying newer measurements from the history */
+	void integrateWithHistory( HistoryEntry& e )
+	{
+		if ( m_history.empty() || e.time >= m_history.back().time )
+		{
+			// in sequence
+			e.pStateBefore = snapshot();
+			apply( e );
+			m_history.push_back( e );
+		}
+		else if ( e.time < m_history.front().time )
+		{
+			LOG4CPP_DEBUG( logger, getName() << ": measurement is older than the history, integrating at current time" );
+			apply( e );
+			return;
+		}
+		else
+		{
+			// restore the state before the first newer measurement
+			std::deque< HistoryEntry >::iterator it = m_history.begin();
+			while ( it->time <= e.time )
+				it++;
+			m_pKF->assign( *it->pStateBefore );
+
+			e.pStateBefore = snapshot();
+			apply( e );
+			double innovation( m_updateInnovation );
+			double nis( m_updateNis );
+			it = m_history.insert( it, e );
+
+			// replay
+			std::size_t nReplayed( 0 );
+			for ( it++; it != m_history.end(); it++, nReplayed++ )
+			{
+				it->pStateBefore->assign( *m_pKF );
+				apply( *it );
+			}
+			m_updateInnovation = innovation;
+			m_updateNis = nis;
+
+			LOG4CPP_TRACE( logger, getName() << ": integrated late measurement, replayed " << nReplayed << " measurements" );
+		}
+
+		// drop old entries, keeping their states for reuse
+		while ( m_history.front().time + m_historyTime < m_history.back().time )
+		{
+			m_spareStates.push_back( m_history.front().pStateBefore );
+			m_history.pop_front();
+		}
+	}
+
+	/** returns a copy of the current filter state, reusing a dropped one if possible */
+	boost::shared_ptr< PoseFilter > snapshot()
+	{
+		if ( m_spareStates.empty() )
+			return boost::shared_ptr< PoseFilter >( m_pKF->clone() );
+
+		boost::shared_ptr< PoseFilter > pState( m_spareStates.back() );
+		m_spareStates.pop_back();
+		pState->assign( *m_pKF );
+		return pState;
+	}
+
+	/** predicts the pose at time t, reusing the result of earlier requests for the same time */
+	Measurement::ErrorPose predict( Measurement::Timestamp t )
+	{
+		unsigned long generation;
+		Measurement::ErrorPose m;
+		if ( !m_predictions.lookup( t, m, generation ) )
+		{
+			m = m_pKF->predictPose( t );
+			m_predictions.store( t, m, generation );
+		}
+		return m;
+	}
+
+	/** logs state and telemetry */
+	void receiveDump( const Measurement::Button& )
+	{
+		std::ostringstream s;
+		s << "state: " << *m_pKF << std::endl;
+		if ( m_telemetry.enabled() )
+			m_telemetry.dump( s );
+		LOG4CPP_INFO( logger, getName() << " telemetry:" << std::endl << s.str() );
+	}
+
 	/** sends a measurement to connected push consumers */
 	void checkSend( Measurement::Timestamp t )
 	{
@@ -240,7 +493,7 @@ protected:
 					return;
 
 			LOG4CPP_TRACE( logger, "Sending pose" );
-			m_outPush.send( m_pKF->predictPose( t ) );
+			m_outPush.send( predict( t ) );
 		}
 	}
 
@@ -254,9 +507,31 @@ protected:
 	Dataflow::PullSupplier< Measurement::ErrorPose > m_out;
 	Dataflow::PushSupplier< Measurement::ErrorPose > m_outPush;
 
+	// optional port that triggers logging of the telemetry
+	boost::scoped_ptr< Dataflow::PushConsumer< Measurement::Button > > m_pDumpPort;
+
+	// statistics of recent filter updates
+	FilterTelemetry m_telemetry;
+
+	// statistics of the last update for the telemetry
+	double m_updateInnovation;
+	double m_updateNis;
+
+	// time span of the history in ns, 0 if disabled
+	Measurement::Timestamp m_historyTime;
+
+	// recent measurements with the filter states before them, oldest first
+	std::deque< HistoryEntry > m_history;
+
+	// filter states of dropped history entries
+	std::vector< boost::shared_ptr< PoseFilter > > m_spareStates;
+
+	// recent predictions, invalidated on every update
+	PredictionCache< Measurement::ErrorPose > m_predictions;
+
 
 	// the kalman filter
-	boost::scoped_ptr< Tracking::PoseKalmanFilter > m_pKF;
+	boost::scoped_ptr< PoseFilter > m_pKF;
 };
 
 
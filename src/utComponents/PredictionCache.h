@@ -0,0 +1,123 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#ifndef __UBITRACK_COMPONENTS_PREDICTIONCACHE_H_INCLUDED__
+#define __UBITRACK_COMPONENTS_PREDICTIONCACHE_H_INCLUDED__
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Cache of predicted measurements for pull ports
+ */
+
+#include <boost/thread/mutex.hpp>
+#include <utMeasurement/Measurement.h>
+
+namespace Ubitrack { namespace Components {
+
+/**
+ * @ingroup dataflow_components
+ * Keeps the last few measurements computed for a pull port, keyed by timestamp.
+ *
+ * Components call invalidate() whenever their state changes. A result computed while the state
+ * changed is not stored, therefore the lookup is done first to get the generation of the state:
+ * @code
+ * unsigned long generation;
+ * Measurement::ErrorPose m;
+ * if ( !m_cache.lookup( t, m, generation ) )
+ * {
+ *     m = predict( t );
+ *     m_cache.store( t, m, generation );
+ * }
+ * @endcode
+ */
+template< class MeasurementType, std::size_t Size = 4 >
+class PredictionCache
+{
+public:
+	PredictionCache()
+		: m_generation( 0 )
+		, m_next( 0 )
+		, m_count( 0 )
+	{}
+
+	/**
+	 * looks up the measurement for time t.
+	 * @param generation is set to the current generation, to be passed to store()
+	 * @return true if the measurement was found
+	 */
+	bool lookup( Measurement::Timestamp t, MeasurementType& m, unsigned long& generation ) const
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+		generation = m_generation;
+		for ( std::size_t i = 0; i < m_count; i++ )
+			if ( m_times[ i ] == t )
+			{
+				m = m_measurements[ i ];
+				return true;
+			}
+		return false;
+	}
+
+	/** stores a measurement, unless the cache was invalidated since the lookup */
+	void store( Measurement::Timestamp t, const MeasurementType& m, unsigned long generation )
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+		if ( generation != m_generation )
+			return;
+
+		m_times[ m_next ] = t;
+		m_measurements[ m_next ] = m;
+		m_next = ( m_next + 1 ) % Size;
+		if ( m_count < Size )
+			m_count++;
+	}
+
+	/** removes all measurements, to be called on every state change */
+	void invalidate()
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+		m_generation++;
+		m_count = 0;
+		m_next = 0;
+	}
+
+protected:
+	mutable boost::mutex m_mutex;
+
+	Measurement::Timestamp m_times[ Size ];
+	MeasurementType m_measurements[ Size ];
+
+	/** incremented on every invalidation */
+	unsigned long m_generation;
+
+	/** index of the next entry to write */
+	std::size_t m_next;
+
+	/** number of valid entries */
+	std::size_t m_count;
+};
+
+} } // namespace Ubitrack::Components
+
+#endif
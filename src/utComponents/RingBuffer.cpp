@@ -33,24 +33,38 @@
  */
 
 #include <vector>
+#include <boost/shared_ptr.hpp>
 #include <utDataflow/TriggerComponent.h>
 #include <utDataflow/TriggerInPort.h>
 #include <utDataflow/TriggerOutPort.h>
 #include <utDataflow/Component.h>
 #include <utDataflow/ComponentFactory.h>
 #include <utMeasurement/Measurement.h>
+#include <utUtil/Exception.h>
 
 
 static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Components.RingBuffer" ) );
 
 namespace Ubitrack { namespace Components {
 
+/**
+ * @ingroup dataflow_components
+ * Ring buffer of the last \c size measurements.
+ *
+ * @par Operation
+ * Nothing is sent until the buffer is full. Afterwards, each input replaces the oldest element
+ * and the whole buffer (in storage order) is sent.
+ * The buffer is shared with the sent measurement and is only copied if a receiver still
+ * holds the previous list when the next input arrives (copy-on-write), otherwise it is updated in place.
+ */
 template< class EventType >
 class RingBuffer
 	: public Dataflow::TriggerComponent
 {
 
 public:
+	typedef std::vector< typename EventType::value_type > ListType;
+
 	/**
 	 * UTQL component constructor.
 	 *
@@ -63,36 +77,46 @@ public:
 		, m_outPort( "Output", *this )
 		, m_size( 0 ) // number of elements
 		, m_position_buffer( 0 )
+		, m_pList( new ListType )
 	{
-		m_list.clear();
 		if( cfg->m_DataflowAttributes.hasAttribute( "size" ) )
 		{
 			cfg->m_DataflowAttributes.getAttributeData( "size", m_size );
-			m_list.reserve( m_size );
 			LOG4CPP_TRACE( logger, "desired list size: " << m_size );
 		}
+		if ( m_size == 0 )
+			UBITRACK_THROW( "RingBuffer requires a size greater than 0" );
+		m_pList->reserve( m_size );
 	}
 
 	/** Method that computes the result. */
 	void compute( Measurement::Timestamp t )
 	{
-		
-		if( m_list.size() < m_list.capacity() )
+		// copy-on-write: only copy the buffer if the last sent list is still referenced
+		if ( !m_pList.unique() )
 		{
-			m_list.push_back( *m_inPort.get() );
-			if( m_list.size() < m_list.capacity())
+			boost::shared_ptr< ListType > pCopy( new ListType );
+			pCopy->reserve( m_size );
+			pCopy->assign( m_pList->begin(), m_pList->end() );
+			m_pList = pCopy;
+		}
+
+		if( m_pList->size() < m_size )
+		{
+			m_pList->push_back( *m_inPort.get() );
+			if( m_pList->size() < m_size )
 			{
-				LOG4CPP_TRACE( logger, "Ring Buffer not yet full, reached " << m_list.size() << " of " << m_list.capacity() << " measurements." );
-				UBITRACK_THROW( "Ring buffer not full. need to add more measurements." );
+				LOG4CPP_TRACE( logger, "Ring Buffer not yet full, reached " << m_pList->size() << " of " << m_size << " measurements." );
 				return;
 			}
-			m_outPort.send( Measurement::Measurement< typename std::vector< typename EventType::value_type > >( t, m_list ) );
-			return;
 		}
-		
-		m_list[ m_position_buffer++ ] = *m_inPort.get();
-		m_position_buffer = m_position_buffer % m_size;
- 		m_outPort.send( Measurement::Measurement< typename std::vector< typename EventType::value_type > >( t, m_list ) );
+		else
+		{
+			( *m_pList )[ m_position_buffer++ ] = *m_inPort.get();
+			m_position_buffer = m_position_buffer % m_size;
+		}
+
+		m_outPort.send( Measurement::Measurement< ListType >( t, m_pList ) );
 	}
 
 	
@@ -101,7 +125,7 @@ protected:
 	Dataflow::TriggerInPort< EventType > m_inPort;
 	
 	/** Output port of the component. */
-	Dataflow::TriggerOutPort< Measurement::Measurement< typename std::vector< typename EventType::value_type > > > m_outPort;
+	Dataflow::TriggerOutPort< Measurement::Measurement< ListType > > m_outPort;
 	
 	/** size of list to aggregate */
 	std::size_t m_size;
@@ -109,8 +133,8 @@ protected:
 	/** points to next element to override */
 	std::size_t m_position_buffer;
 
-	/** ring buffer */
-	std::vector< typename EventType::value_type > m_list;
+	/** ring buffer, shared with the last sent measurement */
+	boost::shared_ptr< ListType > m_pList;
 };
 
 
@@ -40,6 +40,8 @@
 #include <utMeasurement/Measurement.h>
 #include <utCalibration/RotationHecKalmanFilter.h>
 
+#include "PredictionCache.h"
+
 // get a logger
 static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Components.RotHecKalmanFilter" ) );
 
@@ -117,6 +119,7 @@ public:
 			if ( bValidAngle )
 			{
 				m_kf.addMeasurement( deltaA, deltaB );
+				m_results.invalidate();
 				LOG4CPP_DEBUG( logger, "Computed transformation " << m_kf.getResult() );
 			}
 			else
@@ -135,7 +138,14 @@ public:
 
 	Measurement::Rotation sendOut( Measurement::Timestamp t )
 	{
-		return Measurement::Rotation( t, m_kf.getResult() );
+		unsigned long generation;
+		Measurement::Rotation m;
+		if ( !m_results.lookup( t, m, generation ) )
+		{
+			m = Measurement::Rotation( t, m_kf.getResult() );
+			m_results.store( t, m, generation );
+		}
+		return m;
 	}
 
 protected:
@@ -158,6 +168,9 @@ protected:
 	// Output ports of the component
 	Dataflow::PullSupplier< Measurement::Rotation > m_out;
 
+	// results of recent requests, invalidated when a measurement is added
+	PredictionCache< Measurement::Rotation > m_results;
+
 	// the kalman filter
 	Calibration::RotationHecKalmanFilter m_kf;
 };
@@ -31,6 +31,7 @@
  */
 
 #include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
 #include <log4cpp/Category.hh>
 
 #include <utDataflow/Component.h>
@@ -40,6 +41,8 @@
 #include <utMeasurement/Measurement.h>
 #include <utTracking/RotationOnlyKF.h>
 
+#include "GyroPreintegration.h"
+
 // get a logger
 static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Components.RotOnlyKalmanFilter" ) );
 
@@ -57,11 +60,23 @@ namespace Ubitrack { namespace Components {
  * PullSupplier< Rotation > with name "Output".
  *
  * @par Configuration
- * None.
+ * - DataflowConfiguration Attribute "gyroBatchTime": maximum time span in ms of velocity measurements that are
+ *   accumulated before they are integrated, default 0 (integrate each measurement)
  *
  * @par Operation
  * integrates absolute and relative measurements. relative measurements must be calibrated before!
  * Make sure timestamps are reasonably correct!
+ *
+ * With gyroBatchTime > 0, velocity measurements are preintegrated into one delta rotation. The filter is only
+ * updated when an absolute measurement arrives, a rotation is pulled or the batch gets too long. Each measurement
+ * is valid until the next one, like in the filter itself: the last measurement of a batch is integrated until the
+ * time of the flush and continues into the next batch, so consecutive batches leave no gap. The batch is then
+ * integrated as one measurement of its mean rotation velocity at the start of the batch. The filter keeps that
+ * velocity until the next measurement, i.e. it is rotated by the preintegrated rotation over the batch.
+ * Tracking::RotationOnlyKF applies its fixed velocity noise to every measurement, so the mean of a batch only gets
+ * the weight of a single measurement. This is conservative: the filter trusts a batch of N measurements less than
+ * their individual updates, whose combined noise would be 1/N of that of one measurement.
+ * As pulls may flush the batch, the filter is protected by a mutex.
  */
 class RotOnlyKalmanFilterComponent
 	: public Dataflow::Component
@@ -73,18 +88,27 @@ public:
 	 * @param sName Unique name of the component.
 	 * @param subgraph UTQL subgraph
 	 */
-	RotOnlyKalmanFilterComponent( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph >  )
+	RotOnlyKalmanFilterComponent( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
 		: Dataflow::Component( sName )
 		, m_inAbsolute( "InAbsolute", *this, boost::bind( &RotOnlyKalmanFilterComponent::receiveAbsolute, this, _1 ) )
 		, m_inVelocity( "InVelocity", *this, boost::bind( &RotOnlyKalmanFilterComponent::receiveVelocity, this, _1 ) )
 		, m_out( "Output", *this, boost::bind( &RotOnlyKalmanFilterComponent::sendOut, this, _1 ) )
+		, m_batchTime( 0 )
+		, m_batchStart( 0 )
+		, m_batchEnd( 0 )
+		, m_nBatched( 0 )
     {
+		double batchTime( 0 );
+		subgraph->m_DataflowAttributes.getAttributeData( "gyroBatchTime", batchTime );
+		m_batchTime = Measurement::Timestamp( batchTime * 1e6 ); //ms to ns
     }
 
 	/** integrates an absolute measurement. */
 	void receiveAbsolute( const Measurement::Rotation& m )
 	{
 		LOG4CPP_DEBUG( logger, "Received absolute measurement: " << m );
+		boost::mutex::scoped_lock l( m_mutex );
+		flushVelocities( m.time() );
 		LOG4CPP_TRACE( logger, "state before: " << m_kf.getState() );
 
 		m_kf.addRotationMeasurement( m );
@@ -96,6 +120,14 @@ public:
 	void receiveVelocity( const Measurement::RotationVelocity& m )
 	{
 		LOG4CPP_DEBUG( logger, "Received velocity measurement: " << m );
+		boost::mutex::scoped_lock l( m_mutex );
+
+		if ( m_batchTime )
+		{
+			batchVelocity( m );
+			return;
+		}
+
 		LOG4CPP_TRACE( logger, "state before: " << m_kf.getState() );
 
 		m_kf.addVelocityMeasurement( m );
@@ -107,12 +139,71 @@ public:
 	Measurement::Rotation sendOut( Measurement::Timestamp t )
 	{
 		LOG4CPP_DEBUG( logger, "Computing rotation for t=" << t );
+		boost::mutex::scoped_lock l( m_mutex );
+		flushVelocities( t );
 		LOG4CPP_TRACE( logger, "state: " << m_kf.getState() );
 
 		return m_kf.predict( t );
 	}
 
 protected:
+	/** adds a velocity measurement to the batch */
+	void batchVelocity( const Measurement::RotationVelocity& m )
+	{
+		if ( m_nBatched && m.time() <= m_lastVelocity.time() )
+		{
+			// out of order, start a new batch
+			flushVelocities( m_lastVelocity.time() );
+			m_nBatched = 0;
+		}
+
+		if ( !m_nBatched )
+			m_batchStart = m_batchEnd = m.time();
+		else if ( m.time() > m_batchEnd )
+			integrateLastVelocity( m.time() );
+		// else a pull already integrated the last measurement beyond this one, which is valid from then on
+
+		m_lastVelocity = m;
+		m_nBatched++;
+
+		if ( m.time() - m_batchStart > m_batchTime )
+			flushVelocities( m.time() );
+	}
+
+	/** integrates the last velocity measurement from the end of the batch until t */
+	void integrateLastVelocity( Measurement::Timestamp t )
+	{
+		double omega[ 3 ] = { ( *m_lastVelocity )( 0 ), ( *m_lastVelocity )( 1 ), ( *m_lastVelocity )( 2 ) };
+		m_preintegration.integrate( omega, ( t - m_batchEnd ) * 1e-9, 0.0 );
+		m_batchEnd = t;
+	}
+
+	/**
+	 * integrates the batched velocity measurements until t into the filter. The last measurement starts the
+	 * next batch.
+	 */
+	void flushVelocities( Measurement::Timestamp t )
+	{
+		if ( !m_nBatched )
+			return;
+
+		if ( t > m_batchEnd )
+			integrateLastVelocity( t );
+		if ( m_batchEnd == m_batchStart )
+			return;
+
+		const double* q( m_preintegration.rotation() );
+		Measurement::RotationVelocity mean( m_batchStart, Math::RotationVelocity( Math::Quaternion( 0, 0, 0, 1 ),
+			Math::Quaternion( q[ 0 ], q[ 1 ], q[ 2 ], q[ 3 ] ), ( m_batchEnd - m_batchStart ) * 1e-9 ) );
+
+		LOG4CPP_TRACE( logger, "integrating " << m_nBatched << " velocity measurements as " << mean );
+		m_kf.addVelocityMeasurement( mean );
+
+		m_preintegration.reset();
+		m_batchStart = m_batchEnd;
+		m_nBatched = 1;
+	}
+
 	// Input ports of the component.
 	Dataflow::PushConsumer< Measurement::Rotation > m_inAbsolute;
 	Dataflow::PushConsumer< Measurement::RotationVelocity > m_inVelocity;
@@ -122,6 +213,19 @@ protected:
 
 	// the kalman filter
 	Tracking::RotationOnlyKF m_kf;
+
+	// maximum time span of a velocity batch in ns, 0 if batching is disabled
+	Measurement::Timestamp m_batchTime;
+
+	// batched velocity measurements
+	GyroPreintegration m_preintegration;
+	Measurement::Timestamp m_batchStart;
+	Measurement::Timestamp m_batchEnd;
+	Measurement::RotationVelocity m_lastVelocity;
+	std::size_t m_nBatched;
+
+	// protects filter and batch, as pulls flush the batch
+	boost::mutex m_mutex;
 };
 
 
@@ -0,0 +1,167 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#ifndef __UBITRACK_COMPONENTS_RUNNINGSTATISTICS_H_INCLUDED__
+#define __UBITRACK_COMPONENTS_RUNNINGSTATISTICS_H_INCLUDED__
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Running mean and covariance of fixed-size vectors
+ */
+
+#include <cstddef>
+
+namespace Ubitrack { namespace Components {
+
+/**
+ * @ingroup dataflow_components
+ * Running mean and covariance of N-dimensional samples (Welford's algorithm).
+ *
+ * Samples can be added and removed in constant time, which allows sliding windows.
+ * Accumulators of disjoint sets of samples can be merged.
+ * Removing samples accumulates rounding errors over time, users of \c remove should
+ * recompute the statistics from their window from time to time.
+ *
+ * The covariance is normalized by the number of samples, like in the other
+ * covariance estimating components.
+ */
+template< std::size_t N >
+class RunningStatistics
+{
+public:
+	RunningStatistics()
+	{
+		reset();
+	}
+
+	/** removes all samples */
+	void reset()
+	{
+		m_count = 0;
+		for ( std::size_t i = 0; i < N; i++ )
+		{
+			m_mean[ i ] = 0.0;
+			for ( std::size_t j = 0; j < N; j++ )
+				m_m2[ i ][ j ] = 0.0;
+		}
+	}
+
+	/** adds a sample */
+	void add( const double* x )
+	{
+		m_count++;
+
+		double delta[ N ];
+		for ( std::size_t i = 0; i < N; i++ )
+		{
+			delta[ i ] = x[ i ] - m_mean[ i ];
+			m_mean[ i ] += delta[ i ] / m_count;
+		}
+
+		// M2 += ( x - mean_old ) * ( x - mean_new )^T
+		for ( std::size_t i = 0; i < N; i++ )
+			for ( std::size_t j = i; j < N; j++ )
+				m_m2[ i ][ j ] += delta[ i ] * ( x[ j ] - m_mean[ j ] );
+	}
+
+	/** removes a sample that was added before */
+	void remove( const double* x )
+	{
+		if ( m_count <= 1 )
+		{
+			reset();
+			return;
+		}
+
+		m_count--;
+
+		double delta[ N ];
+		for ( std::size_t i = 0; i < N; i++ )
+		{
+			delta[ i ] = x[ i ] - m_mean[ i ];
+			m_mean[ i ] -= delta[ i ] / m_count;
+		}
+
+		// M2 -= ( x - mean_old ) * ( x - mean_new )^T
+		for ( std::size_t i = 0; i < N; i++ )
+			for ( std::size_t j = i; j < N; j++ )
+				m_m2[ i ][ j ] -= delta[ i ] * ( x[ j ] - m_mean[ j ] );
+	}
+
+	/** adds all samples of another accumulator, e.g. computed by another thread (Chan et al.) */
+	void merge( const RunningStatistics& other )
+	{
+		if ( other.m_count == 0 )
+			return;
+		if ( m_count == 0 )
+		{
+			*this = other;
+			return;
+		}
+
+		double n = double( m_count + other.m_count );
+		double weight = double( m_count ) * double( other.m_count ) / n;
+
+		double delta[ N ];
+		for ( std::size_t i = 0; i < N; i++ )
+		{
+			delta[ i ] = other.m_mean[ i ] - m_mean[ i ];
+			m_mean[ i ] += delta[ i ] * other.m_count / n;
+		}
+
+		// M2 = M2_a + M2_b + delta * delta^T * n_a * n_b / n
+		for ( std::size_t i = 0; i < N; i++ )
+			for ( std::size_t j = i; j < N; j++ )
+				m_m2[ i ][ j ] += other.m_m2[ i ][ j ] + delta[ i ] * delta[ j ] * weight;
+
+		m_count += other.m_count;
+	}
+
+	/** number of samples */
+	std::size_t count() const
+	{ return m_count; }
+
+	/** mean of all samples */
+	const double* mean() const
+	{ return m_mean; }
+
+	/** covariance element (i, j) */
+	double covariance( std::size_t i, std::size_t j ) const
+	{
+		if ( m_count == 0 )
+			return 0.0;
+		return ( i <= j ? m_m2[ i ][ j ] : m_m2[ j ][ i ] ) / m_count;
+	}
+
+protected:
+	std::size_t m_count;
+	double m_mean[ N ];
+
+	/** sum of squared deviations, only the upper triangle is used */
+	double m_m2[ N ][ N ];
+};
+
+} } // namespace Ubitrack::Components
+
+#endif
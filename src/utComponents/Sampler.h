@@ -31,11 +31,22 @@
  * @author Adnane Jadid <jadid@in.tum.de>
  */
 
+#include <cmath>
+#include <algorithm>
+
 #include <boost/scoped_ptr.hpp>
 #include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <log4cpp/Category.hh>
 
+#ifdef __linux__
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#define UBITRACK_SAMPLER_ABSOLUTE_SCHEDULING
+#endif
+
 #include <utDataflow/Component.h>
 #include <utDataflow/PullConsumer.h>
 #include <utDataflow/PushSupplier.h>
@@ -44,6 +55,8 @@
 #include <utUtil/Exception.h>
 #include <utUtil/OS.h>
 
+#include "TimerService.h"
+
 // get a logger
 static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Components.Sampler" ) );
 static log4cpp::Category& eventLogger( log4cpp::Category::getInstance( "Ubitrack.Events.Components.Sampler" ) );
@@ -61,10 +74,23 @@ namespace Ubitrack { namespace Components {
  * PushSupplier< EventType > with name "Output".
  *
  * @par Configuration
- * @verbatim <Configuration frequency="100"/> @endverbatim
+ * @verbatim <Configuration frequency="100" offset="0" scheduling="absolute" spinTime="100" priority="0" cpu="-1" statistics="0"/> @endverbatim
  * \c frequency: floating point number giving the sampling frequency in Hz
+ * \c offset: clock offset in seconds that is added to the query time
+ * \c scheduling: "sleep" (default) uses relative sleeps, "absolute" sleeps until absolute deadlines
+ *   on the monotonic clock, which does not accumulate drift (Linux only, falls back to "sleep" elsewhere).
+ *   "shared" registers with the process-wide TimerService instead of running an own thread, samplers with
+ *   the same frequency are then triggered together. \c spinTime, \c priority, \c cpu and \c statistics
+ *   are ignored in this mode.
+ * \c spinTime: microseconds before each deadline that are busy-waited instead of slept (only "absolute")
+ * \c priority: if greater than 0, the sampling thread is run with this SCHED_FIFO realtime priority
+ * \c cpu: if not negative, the sampling thread is pinned to this CPU
+ * \c statistics: if greater than 0, the achieved period and jitter are logged every n samples
  *
  * @par Operation
+ * A separate thread pulls the input and pushes the result. In "absolute" mode, deadlines are computed
+ * as multiples of the period from the start time. If sampling is late, missed ticks are skipped
+ * but the phase is kept.
  *
  * @par Instances
  *
@@ -86,6 +112,14 @@ public:
 		, m_outPort( "Output", *this )
 		, m_fFrequency( 1.0 )
 		, m_nOffset( 0 )
+		, m_bAbsoluteScheduling( false )
+		, m_bSharedTimer( false )
+		, m_timerHandle( 0 )
+		, m_nSpinTime( 0 )
+		, m_priority( 0 )
+		, m_cpu( -1 )
+		, m_statisticsInterval( 0 )
+		, m_statLastTick( 0 )
 		, m_bStop( true )
     {
 		subgraph->m_DataflowAttributes.getAttributeData( "frequency", m_fFrequency );
@@ -93,6 +127,26 @@ public:
 		double offset( 0 );
 		subgraph->m_DataflowAttributes.getAttributeData( "offset", offset );
 		m_nOffset = (long long int)( 1e9 * offset );
+
+		std::string scheduling( subgraph->m_DataflowAttributes.getAttributeString( "scheduling" ) );
+		if ( scheduling == "shared" )
+			m_bSharedTimer = true;
+		else if ( scheduling == "absolute" )
+		{
+#ifdef UBITRACK_SAMPLER_ABSOLUTE_SCHEDULING
+			m_bAbsoluteScheduling = true;
+#else
+			LOG4CPP_WARN( logger, "Absolute scheduling is not supported on this platform, using relative sleeps" );
+#endif
+		}
+
+		double spinTime( 0 );
+		subgraph->m_DataflowAttributes.getAttributeData( "spinTime", spinTime );
+		m_nSpinTime = (long long int)( 1e3 * spinTime );
+
+		subgraph->m_DataflowAttributes.getAttributeData( "priority", m_priority );
+		subgraph->m_DataflowAttributes.getAttributeData( "cpu", m_cpu );
+		subgraph->m_DataflowAttributes.getAttributeData( "statistics", m_statisticsInterval );
 		
 		stop();
     }
@@ -103,7 +157,7 @@ public:
 	}
 
 	/**
-	 * component start method, starts thread
+	 * component start method, starts thread or registers with the timer service
 	 */
 	virtual void start()
 	{
@@ -111,7 +165,10 @@ public:
 		{
 			m_running = true;
 			m_bStop = false;
-			m_pThread.reset( new boost::thread( boost::bind( &Sampler< EventType >::threadMethod, this ) ) );
+			if ( m_bSharedTimer )
+				m_timerHandle = TimerService::singleton().add( m_fFrequency, boost::bind( &Sampler< EventType >::timerTick, this, _1 ) );
+			else
+				m_pThread.reset( new boost::thread( boost::bind( &Sampler< EventType >::threadMethod, this ) ) );
 		}
 	}
 
@@ -126,6 +183,11 @@ public:
 		{
 			m_running = false;
 			m_bStop = true;
+			if ( m_timerHandle )
+			{
+				TimerService::singleton().remove( m_timerHandle );
+				m_timerHandle = 0;
+			}
 			if ( m_pThread )
 			{
 				m_pThread->join();
@@ -138,6 +200,25 @@ protected:
 	/** Method that computes the result. */
 	void threadMethod();
 
+	/** Thread method for absolute deadline scheduling */
+	void threadMethodAbsolute();
+
+	/** called by the shared timer service */
+	void timerTick( Measurement::Timestamp t )
+	{ sample( t + m_nOffset ); }
+
+	/** pulls the input for the given time and pushes the result */
+	void sample( Measurement::Timestamp t );
+
+	/** applies realtime priority and CPU affinity to the calling thread */
+	void configureThread();
+
+	/** clears the accumulated statistics */
+	void resetStatistics();
+
+	/** adds a tick to the statistics and logs them if the interval is complete */
+	void updateStatistics( long long int tickTime, long long int deadline );
+
 	/** Input port of the component. */
 	Dataflow::PullConsumer< EventType > m_inPort;
 
@@ -149,6 +230,36 @@ protected:
 
 	// offset to add to sampled timestamps
 	long long int m_nOffset;
+
+	// sleep until absolute deadlines instead of relative sleeps
+	bool m_bAbsoluteScheduling;
+
+	// use the shared timer service instead of an own thread
+	bool m_bSharedTimer;
+
+	// registration with the timer service
+	TimerService::Handle m_timerHandle;
+
+	// nanoseconds before a deadline to busy-wait
+	long long int m_nSpinTime;
+
+	// realtime priority of the sampling thread (0: don't change)
+	int m_priority;
+
+	// CPU to pin the sampling thread to (-1: don't pin)
+	int m_cpu;
+
+	// number of samples after which statistics are logged (0: off)
+	int m_statisticsInterval;
+
+	// period and jitter statistics since the last report
+	int m_statCount;
+	int m_statMissed;
+	long long int m_statLastTick;
+	double m_statPeriodSum;
+	double m_statPeriodSqSum;
+	double m_statLatenessSum;
+	long long int m_statLatenessMax;
 	
 	// stop?
 	bool m_bStop;
@@ -160,6 +271,18 @@ protected:
 template< class EventType >
 void Sampler< EventType >::threadMethod()
 {
+	configureThread();
+	resetStatistics();
+	m_statLastTick = 0;
+
+#ifdef UBITRACK_SAMPLER_ABSOLUTE_SCHEDULING
+	if ( m_bAbsoluteScheduling )
+	{
+		threadMethodAbsolute();
+		return;
+	}
+#endif
+
 	Measurement::Timestamp step = Measurement::Timestamp( 1 / m_fFrequency * 1e9 );
 	Measurement::Timestamp now( Measurement::now() );
 	Measurement::Timestamp nextTime( now + step );
@@ -167,6 +290,7 @@ void Sampler< EventType >::threadMethod()
 	while ( !m_bStop )
 	{
 		// compute sleep time and sleep
+		Measurement::Timestamp deadline( nextTime );
 		now = Measurement::now();
 		if ( now < nextTime )
 		{
@@ -178,25 +302,161 @@ void Sampler< EventType >::threadMethod()
 		else
 		{
 			// sampling took more than the sleep duration -> yield some processing time to other threads
+			// and count the ticks that are skipped by restarting from now
+			m_statMissed += int( ( now - nextTime ) / step );
 			nextTime = now + step;
 			boost::thread::yield();
 		}
 
-		// do sampling
-		now = Measurement::now() + m_nOffset;
-		try
-		{
-			m_outPort.send( m_inPort.get( now ) );
-		}
-		catch ( const Util::Exception& e )
+		if ( m_statisticsInterval > 0 )
+			updateStatistics( Measurement::now(), deadline );
+
+		sample( Measurement::now() + m_nOffset );
+	}
+}
+
+
+template< class EventType >
+void Sampler< EventType >::threadMethodAbsolute()
+{
+#ifdef UBITRACK_SAMPLER_ABSOLUTE_SCHEDULING
+	const long long int nsPerSec = 1000000000LL;
+	const long long int step = (long long int)( nsPerSec / m_fFrequency );
+	const long long int spin = std::min( m_nSpinTime, step );
+
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	long long int deadline = ts.tv_sec * nsPerSec + ts.tv_nsec + step;
+
+	while ( !m_bStop )
+	{
+		// sleep until shortly before the deadline
+		long long int wakeup = deadline - spin;
+		ts.tv_sec = wakeup / nsPerSec;
+		ts.tv_nsec = wakeup % nsPerSec;
+		while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0 ) == EINTR )
+			;
+
+		// busy-wait the remaining time
+		long long int now;
+		do
 		{
-			LOG4CPP_WARN( eventLogger, "Got exception: " << e );
+			clock_gettime( CLOCK_MONOTONIC, &ts );
+			now = ts.tv_sec * nsPerSec + ts.tv_nsec;
 		}
-		catch ( const std::exception& e )
+		while ( spin > 0 && now < deadline );
+
+		if ( m_statisticsInterval > 0 )
+			updateStatistics( now, deadline );
+
+		sample( Measurement::now() + m_nOffset );
+
+		// next deadline, skipping ticks that were missed but keeping the phase
+		deadline += step;
+		clock_gettime( CLOCK_MONOTONIC, &ts );
+		now = ts.tv_sec * nsPerSec + ts.tv_nsec;
+		if ( now >= deadline )
 		{
-			LOG4CPP_WARN( eventLogger, "Got unknown exception: " << e.what() );
+			long long int missed = ( now - deadline ) / step + 1;
+			deadline += missed * step;
+			m_statMissed += int( missed );
 		}
 	}
+#endif
+}
+
+
+template< class EventType >
+void Sampler< EventType >::sample( Measurement::Timestamp t )
+{
+	try
+	{
+		m_outPort.send( m_inPort.get( t ) );
+	}
+	catch ( const Util::Exception& e )
+	{
+		LOG4CPP_WARN( eventLogger, "Got exception: " << e );
+	}
+	catch ( const std::exception& e )
+	{
+		LOG4CPP_WARN( eventLogger, "Got unknown exception: " << e.what() );
+	}
+}
+
+
+template< class EventType >
+void Sampler< EventType >::configureThread()
+{
+	if ( m_priority <= 0 && m_cpu < 0 )
+		return;
+
+#ifdef __linux__
+	if ( m_priority > 0 )
+	{
+		struct sched_param param;
+		param.sched_priority = m_priority;
+		int err = pthread_setschedparam( pthread_self(), SCHED_FIFO, &param );
+		if ( err )
+			LOG4CPP_WARN( logger, "Could not set realtime priority " << m_priority << ": error " << err );
+	}
+
+	if ( m_cpu >= 0 )
+	{
+		cpu_set_t cpus;
+		CPU_ZERO( &cpus );
+		CPU_SET( m_cpu, &cpus );
+		int err = pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+		if ( err )
+			LOG4CPP_WARN( logger, "Could not pin sampling thread to CPU " << m_cpu << ": error " << err );
+	}
+#else
+	LOG4CPP_WARN( logger, "Realtime priority and CPU pinning are not supported on this platform" );
+#endif
+}
+
+
+template< class EventType >
+void Sampler< EventType >::updateStatistics( long long int tickTime, long long int deadline )
+{
+	if ( m_statLastTick == 0 )
+	{
+		// first tick, nothing to compare with
+		m_statLastTick = tickTime;
+		resetStatistics();
+		return;
+	}
+
+	double period = double( tickTime - m_statLastTick );
+	long long int lateness = std::max( tickTime - deadline, 0LL );
+	m_statLastTick = tickTime;
+	m_statCount++;
+	m_statPeriodSum += period;
+	m_statPeriodSqSum += period * period;
+	m_statLatenessSum += double( lateness );
+	m_statLatenessMax = std::max( m_statLatenessMax, lateness );
+
+	if ( m_statCount < m_statisticsInterval )
+		return;
+
+	double mean = m_statPeriodSum / m_statCount;
+	double jitter = std::sqrt( std::max( m_statPeriodSqSum / m_statCount - mean * mean, 0.0 ) );
+	LOG4CPP_INFO( logger, getName() << ": period " << mean * 1e-3 << "us (target " << 1e6 / m_fFrequency
+		<< "us), jitter " << jitter * 1e-3 << "us, mean lateness " << m_statLatenessSum / m_statCount * 1e-3
+		<< "us, max lateness " << m_statLatenessMax * 1e-3 << "us, missed ticks " << m_statMissed );
+
+	resetStatistics();
+}
+
+
+template< class EventType >
+void Sampler< EventType >::resetStatistics()
+{
+	m_statCount = 0;
+	m_statMissed = 0;
+	m_statPeriodSum = 0;
+	m_statPeriodSqSum = 0;
+	m_statLatenessSum = 0;
+	m_statLatenessMax = 0;
 }
 
 } } // namespace Ubitrack::Components
@@ -39,6 +39,8 @@
 #include <utDataflow/ComponentFactory.h>
 #include <utMeasurement/Measurement.h>
 
+#include "ListPool.h"
+
 
 static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Components.TimeSpaceConverter" ) );
 
@@ -50,6 +52,8 @@ class TimeSpaceConverter
 {
 
 public:
+	typedef std::vector< typename EventType::value_type > ListType;
+
 	/**
 	 * UTQL component constructor.
 	 *
@@ -62,7 +66,6 @@ public:
 		, m_outPort( "Output", *this )
 		, m_size( 30 )
 	{
-		m_list.clear();
 		cfg->m_DataflowAttributes.getAttributeData( "size", m_size );
 	}
 
@@ -71,12 +74,19 @@ public:
 	{
 		LOG4CPP_TRACE( logger, "desired list size: " << m_size );
 
+		// Start a new list from the pool
+		if ( !m_pList )
+		{
+			m_pList = m_pool.acquire();
+			m_pList->reserve( m_size );
+		}
+
 		// Retrieve and store measurement
-		m_list.push_back( *m_inPort.get() );
+		m_pList->push_back( *m_inPort.get() );
 
-		LOG4CPP_TRACE( logger, "current size: " << m_list.size() );
+		LOG4CPP_TRACE( logger, "current size: " << m_pList->size() );
 
-		if ( m_list.size() < m_size ) 
+		if ( m_pList->size() < m_size ) 
 		{
 			if ( isPortPush ( "Input" ) ) 
 			{
@@ -85,18 +95,19 @@ public:
 			}
 
 			LOG4CPP_TRACE( logger, "pull inport port, retrieve missing measurements..." );
-			while ( m_list.size() < m_size )
+			while ( m_pList->size() < m_size )
 			{
-				LOG4CPP_TRACE( logger, "items in list: " << m_list.size() << ", pulling next measurement" );
+				LOG4CPP_TRACE( logger, "items in list: " << m_pList->size() << ", pulling next measurement" );
 				
 				m_inPort.pull( t );
-				m_list.push_back( *m_inPort.get() );
+				m_pList->push_back( *m_inPort.get() );
 			};
 		}
 
 		LOG4CPP_TRACE( logger, "desired list size reached" );
- 		m_outPort.send( Measurement::Measurement< typename std::vector< typename EventType::value_type > >( t, m_list ) );
-		m_list.clear();
+		boost::shared_ptr< ListType > pList;
+		pList.swap( m_pList );
+ 		m_outPort.send( Measurement::Measurement< ListType >( t, pList ) );
 	}
 
 	
@@ -105,12 +116,16 @@ protected:
 	Dataflow::TriggerInPort< EventType > m_inPort;
 	
 	/** Output port of the component. */
-	Dataflow::TriggerOutPort< Measurement::Measurement< typename std::vector< typename EventType::value_type > > > m_outPort;
+	Dataflow::TriggerOutPort< Measurement::Measurement< ListType > > m_outPort;
 	
 	/** Size of list to aggregate */
 	unsigned int m_size;
 
-	std::vector< typename EventType::value_type > m_list;
+	/** list currently being filled */
+	boost::shared_ptr< ListType > m_pList;
+
+	/** recycled output lists */
+	ListPool< ListType > m_pool;
 };
 
 
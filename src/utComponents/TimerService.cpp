@@ -0,0 +1,214 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Shared timer thread for periodic components
+ */
+
+#include "TimerService.h"
+
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread/once.hpp>
+#include <log4cpp/Category.hh>
+
+#include <utUtil/Exception.h>
+
+static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Components.TimerService" ) );
+
+namespace Ubitrack { namespace Components {
+
+TimerService* TimerService::s_pInstance = 0;
+
+
+TimerService& TimerService::singleton()
+{
+	static boost::once_flag flag = BOOST_ONCE_INIT;
+	boost::call_once( &TimerService::createInstance, flag );
+	return *s_pInstance;
+}
+
+
+void TimerService::createInstance()
+{
+	// never destroyed to avoid problems with the destruction order of component libraries
+	s_pInstance = new TimerService;
+}
+
+
+TimerService::TimerService()
+	: m_nextHandle( 1 )
+	, m_bExecuting( false )
+	, m_batchCount( 0 )
+{}
+
+
+TimerService::Handle TimerService::add( double frequency, const Callback& callback )
+{
+	if ( frequency <= 0 )
+		UBITRACK_THROW( "Timer frequency must be positive" );
+
+	Measurement::Timestamp period = Measurement::Timestamp( 1e9 / frequency );
+
+	boost::mutex::scoped_lock l( m_mutex );
+
+	Handle h = m_nextHandle++;
+	m_handles[ h ] = period;
+
+	// join an existing group with the same period or start a new one
+	std::map< Measurement::Timestamp, Group >::iterator it = m_groups.find( period );
+	if ( it == m_groups.end() )
+	{
+		Group& group( m_groups[ period ] );
+		group.deadline = Measurement::now() + period;
+		group.callbacks[ h ] = callback;
+		m_queue.push( Deadline( group.deadline, period ) );
+		m_wakeup.notify_one();
+	}
+	else
+		it->second.callbacks[ h ] = callback;
+
+	if ( !m_pThread )
+	{
+		m_pThread.reset( new boost::thread( boost::bind( &TimerService::threadMethod, this ) ) );
+	}
+
+	return h;
+}
+
+
+void TimerService::remove( Handle h )
+{
+	boost::scoped_ptr< boost::thread > pThread;
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+
+		std::map< Handle, Measurement::Timestamp >::iterator it = m_handles.find( h );
+		if ( it == m_handles.end() )
+			return;
+
+		std::map< Measurement::Timestamp, Group >::iterator itGroup = m_groups.find( it->second );
+		itGroup->second.callbacks.erase( h );
+		if ( itGroup->second.callbacks.empty() )
+			m_groups.erase( itGroup ); // the heap entry becomes stale and is dropped later
+		m_handles.erase( it );
+
+		if ( m_pThread && boost::this_thread::get_id() != m_pThread->get_id() )
+		{
+			// wait until the running batch has finished if it contains the callback.
+			// Later batches no longer contain it, so the wait ends when the batch count changes,
+			// even if the timer thread starts the next batch before this thread wakes up.
+			if ( m_bExecuting && std::find( m_batchHandles.begin(), m_batchHandles.end(), h ) != m_batchHandles.end() )
+			{
+				unsigned long batch( m_batchCount );
+				while ( m_bExecuting && m_batchCount == batch )
+					m_executed.wait( l );
+			}
+
+			if ( m_handles.empty() )
+			{
+				// the thread terminates once it is no longer the current timer thread
+				pThread.swap( m_pThread );
+				m_wakeup.notify_all();
+			}
+		}
+	}
+
+	if ( pThread )
+		pThread->join();
+}
+
+
+void TimerService::threadMethod()
+{
+	boost::mutex::scoped_lock l( m_mutex );
+	while ( m_pThread && m_pThread->get_id() == boost::this_thread::get_id() )
+	{
+		if ( m_queue.empty() )
+		{
+			m_wakeup.wait( l );
+			continue;
+		}
+
+		// drop heap entries of removed or rescheduled groups
+		Deadline next( m_queue.top() );
+		std::map< Measurement::Timestamp, Group >::iterator it = m_groups.find( next.second );
+		if ( it == m_groups.end() || it->second.deadline != next.first )
+		{
+			m_queue.pop();
+			continue;
+		}
+
+		Measurement::Timestamp now = Measurement::now();
+		if ( now < next.first )
+		{
+			m_wakeup.timed_wait( l, boost::get_system_time() +
+				boost::posix_time::microseconds( ( next.first - now ) / 1000 + 1 ) );
+			continue;
+		}
+
+		// reschedule, skipping missed ticks but keeping the phase
+		m_queue.pop();
+		Group& group( it->second );
+		group.deadline += next.second;
+		if ( group.deadline <= now )
+			group.deadline += ( ( now - group.deadline ) / next.second + 1 ) * next.second;
+		m_queue.push( Deadline( group.deadline, next.second ) );
+
+		// fire the batch without holding the lock
+		m_batch.clear();
+		m_batchHandles.clear();
+		for ( std::map< Handle, Callback >::iterator itCb = group.callbacks.begin(); itCb != group.callbacks.end(); itCb++ )
+		{
+			m_batchHandles.push_back( itCb->first );
+			m_batch.push_back( itCb->second );
+		}
+		m_bExecuting = true;
+		m_batchCount++;
+		l.unlock();
+
+		for ( std::vector< Callback >::iterator itCb = m_batch.begin(); itCb != m_batch.end(); itCb++ )
+		{
+			try
+			{
+				( *itCb )( now );
+			}
+			catch ( const Util::Exception& e )
+			{
+				LOG4CPP_WARN( logger, "Got exception: " << e );
+			}
+			catch ( const std::exception& e )
+			{
+				LOG4CPP_WARN( logger, "Got unknown exception: " << e.what() );
+			}
+		}
+
+		l.lock();
+		m_bExecuting = false;
+		m_executed.notify_all();
+	}
+}
+
+} } // namespace Ubitrack::Components
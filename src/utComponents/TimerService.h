@@ -0,0 +1,160 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+#ifndef __UBITRACK_COMPONENTS_TIMERSERVICE_H_INCLUDED__
+#define __UBITRACK_COMPONENTS_TIMERSERVICE_H_INCLUDED__
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Shared timer thread for periodic components
+ */
+
+#include <map>
+#include <vector>
+#include <queue>
+#include <functional>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <utMeasurement/Measurement.h>
+
+// the timer service is built as a shared library of its own
+#ifdef _WIN32
+	#ifdef UTCOMPONENTS_TIMERSERVICE_DLL
+		#define UTCOMPONENTS_TIMERSERVICE_EXPORT __declspec( dllexport )
+	#else
+		#define UTCOMPONENTS_TIMERSERVICE_EXPORT __declspec( dllimport )
+	#endif
+#else
+	#define UTCOMPONENTS_TIMERSERVICE_EXPORT __attribute__ ( ( visibility( "default" ) ) )
+#endif
+
+namespace Ubitrack { namespace Components {
+
+/**
+ * @ingroup dataflow_components
+ * Process-wide timer service that calls periodic callbacks from a single thread.
+ *
+ * Instead of running one sleeping thread per periodic component, components register a
+ * callback with a frequency. All callbacks with the same period are kept in one group that
+ * is fired as a batch, the groups are ordered in a min-heap by their next deadline.
+ * The thread is started with the first registration and stopped when the last callback
+ * is removed.
+ *
+ * Callbacks are executed sequentially, so a slow callback delays all others. Components
+ * that need an exact schedule should keep their own thread.
+ *
+ * The class is compiled into the utComponentsTimerService library, which all components
+ * using it link against, so there is exactly one instance per process.
+ */
+class UTCOMPONENTS_TIMERSERVICE_EXPORT TimerService
+	: private boost::noncopyable
+{
+public:
+	/** callback type, gets the time at which the batch was fired */
+	typedef boost::function< void ( Measurement::Timestamp ) > Callback;
+
+	/** handle to identify registered callbacks */
+	typedef unsigned int Handle;
+
+	/** returns the process-wide instance */
+	static TimerService& singleton();
+
+	/**
+	 * registers a periodic callback
+	 * @param frequency calls per second
+	 * @param callback function to call
+	 * @return handle to pass to \c remove
+	 */
+	Handle add( double frequency, const Callback& callback );
+
+	/**
+	 * removes a callback.
+	 * When called from another thread, the callback is guaranteed not to run after this returns.
+	 */
+	void remove( Handle h );
+
+protected:
+	/** all callbacks sharing one period */
+	struct Group
+	{
+		Measurement::Timestamp deadline;
+		std::map< Handle, Callback > callbacks;
+	};
+
+	/** heap entry: deadline and period of a group */
+	typedef std::pair< Measurement::Timestamp, Measurement::Timestamp > Deadline;
+
+	TimerService();
+
+	static void createInstance();
+
+	/** timer thread */
+	void threadMethod();
+
+	/** protects all members below */
+	boost::mutex m_mutex;
+
+	/** signals changes of the schedule and of m_pThread to the timer thread */
+	boost::condition_variable m_wakeup;
+
+	/** signals the end of a batch */
+	boost::condition_variable m_executed;
+
+	/** groups by period */
+	std::map< Measurement::Timestamp, Group > m_groups;
+
+	/** period of each registered handle */
+	std::map< Handle, Measurement::Timestamp > m_handles;
+
+	/** min-heap of group deadlines, may contain stale entries */
+	std::priority_queue< Deadline, std::vector< Deadline >, std::greater< Deadline > > m_queue;
+
+	/** callbacks of the batch currently fired, kept to reuse its capacity */
+	std::vector< Callback > m_batch;
+
+	/** handles of the callbacks in m_batch */
+	std::vector< Handle > m_batchHandles;
+
+	Handle m_nextHandle;
+
+	/** the current timer thread */
+	boost::scoped_ptr< boost::thread > m_pThread;
+
+	/** true while a batch is being fired */
+	bool m_bExecuting;
+
+	/** number of batches started so far */
+	unsigned long m_batchCount;
+
+	/** the instance */
+	static TimerService* s_pInstance;
+};
+
+} } // namespace Ubitrack::Components
+
+#endif
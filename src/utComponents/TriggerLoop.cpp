@@ -38,6 +38,7 @@
 
 #include <utDataflow/Component.h>
 #include <utDataflow/PullConsumer.h>
+#include <utDataflow/PushConsumer.h>
 #include <utDataflow/PushSupplier.h>
 #include <utDataflow/ComponentFactory.h>
 #include <utMeasurement/Measurement.h>
@@ -59,7 +60,7 @@ namespace Ubitrack { namespace Components {
  *
  * @par Input Ports
  * PushConsumer< Button > with name "IterationDone".
- * PushConsumer< Button > with name "ExternalTrigger".
+ * PushConsumer< Button > with name "LoopTrigger".
  *
  * @par Output Ports
  * PushSupplier< Button > with name "LoopDone".
@@ -75,9 +76,12 @@ namespace Ubitrack { namespace Components {
  * lead to the same amount of events being pushed on the {@code
  * IterationDone} input. Finally, one event is pushed onward on the
  * {@code LoopDone} output. An endless loop can be constructed by
- * setting {@link #m_counter} to 0. An event on the {@code
- * ExternalTrigger} resets the component and starts the loop anew.
-
+ * setting {@link #m_size} to 0. An event on the {@code
+ * LoopTrigger} resets the component and starts the loop anew.
+ *
+ * Iterations run one after another. To use several cores in a Monte
+ * Carlo simulation, the computation within an iteration has to be
+ * parallel, e.g. with the threads attribute of AbsoluteOrientationRANSAC.
  *
  * @par Instances
  *
@@ -131,21 +135,27 @@ public:
     {
 		if ( *e == m_inButton )
 		{
-			boost::mutex::scoped_lock l( m_mutex );
-
-			if ( m_bStopped ) 
+			bool bStart( false );
 			{
-				LOG4CPP_DEBUG( logger, getName() << " Received trigger event with timestamp " << e.time() << ". Trigger first loop iteration..." );
-				m_outIterationTrigger.send( Measurement::Button( e.time(), m_button ) );
-				m_bStopped = false;
-
-				// Reset internal state
-				m_counter = 0;
-			}
-			else 
-			{
-				LOG4CPP_ERROR( logger, getName() << " received trigger signal while computation was already running. Ignored." );
+				boost::mutex::scoped_lock l( m_mutex );
+
+				if ( m_bStopped ) 
+				{
+					LOG4CPP_DEBUG( logger, getName() << " Received trigger event with timestamp " << e.time() << ". Trigger first loop iteration..." );
+					m_bStopped = false;
+
+					// Reset internal state
+					m_counter = 0;
+					bStart = true;
+				}
+				else 
+				{
+					LOG4CPP_ERROR( logger, getName() << " received trigger signal while computation was already running. Ignored." );
+				}
 			}
+
+			if ( bStart )
+				m_outIterationTrigger.send( Measurement::Button( e.time(), m_button ) );
 		}
 	}
 
@@ -154,19 +164,24 @@ public:
     {
 		LOG4CPP_TRACE( logger, getName() << " Received loop iteration done event with timestamp " << e.time() );
 
-		m_counter ++;
-		LOG4CPP_TRACE( logger, getName() << " Current counter: " << m_counter << ", go on until: " << m_size );
+		bool bDone;
+		{
+			boost::mutex::scoped_lock l( m_mutex );
 
-		// Check list size
-		if ( m_size > 0 && m_counter == m_size )
+			m_counter ++;
+			LOG4CPP_TRACE( logger, getName() << " Current counter: " << m_counter << ", go on until: " << m_size );
+
+			// Check list size
+			bDone = m_size > 0 && m_counter == m_size;
+			if ( bDone )
+				m_bStopped = true;
+		}
+
+		if ( bDone )
 		{
 			// push onward loop done event
 			LOG4CPP_DEBUG( logger, getName() << " Terminate and push loop done event" );
 			m_outLoopDone.send( Measurement::Button ( e.time(), m_button ) );
-
-			boost::mutex::scoped_lock l( m_mutex );
-			m_bStopped = true;
-
 			return;
 		}
 		
@@ -188,6 +203,7 @@ protected:
 	// stop
 	bool m_bStopped;
 
+	/** number of finished iterations */
 	int m_counter;
 	int m_size;
 
@@ -32,7 +32,9 @@
  * @author Christian Waechter <christian.waechter@in.tum.de>
  */
 
-#include <deque>
+#include <vector>
+#include <algorithm>
+#include <boost/shared_ptr.hpp>
 #include <utDataflow/TriggerComponent.h>
 #include <utDataflow/TriggerInPort.h>
 #include <utDataflow/TriggerOutPort.h>
@@ -45,12 +47,28 @@ static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Comp
 
 namespace Ubitrack { namespace Components {
 
+/**
+ * @ingroup dataflow_components
+ * Aggregates all measurements of the last \c time milliseconds into a list.
+ *
+ * @par Operation
+ * The list holds exactly the window and is shared with the sent measurement. It is only copied if
+ * a receiver still holds the previous list when the next input arrives (copy-on-write), otherwise old
+ * measurements are erased from its front and the new one is appended in place. The list is therefore
+ * not a ring: erasing from the front moves the rest of the window, so every event costs O(window)
+ * element moves. As a list measurement is sent for every event and must contain exactly the window,
+ * this cost cannot be avoided, but no allocation happens per event.
+ * The timestamps of the window are kept in an append-only array with a head index, which is compacted
+ * when the evicted prefix becomes longer than the window, so they cost amortized constant time.
+ */
 template< class EventType >
 class WindowedAggregator
 	: public Dataflow::TriggerComponent
 {
 
 public:
+	typedef std::vector< typename EventType::value_type > ListType;
+
 	/**
 	 * UTQL component constructor.
 	 *
@@ -62,9 +80,9 @@ public:
 		, m_inPort( "Input", *this )
 		, m_outPort( "Output", *this )
 		, m_time( 0.0 ) // duration in nanoseconds
+		, m_head( 0 )
+		, m_pList( new ListType )
 	{
-		m_mList.clear();
-		m_tList.clear();
 		if( cfg->m_DataflowAttributes.hasAttribute( "time" ) )
 		{
 			cfg->m_DataflowAttributes.getAttributeData( "time", m_time );
@@ -76,23 +94,34 @@ public:
 	/** Method that computes the result. */
 	void compute( Measurement::Timestamp t )
 	{
-		//add newest elements to queues
-		m_mList.push_back( *m_inPort.get() );
-		m_tList.push_back( t );
-		
-		//delete oldest elements from queues
-		while( ( m_tList.front() + m_time ) < t )
+		//find the oldest elements that leave the window, the newest one always stays
+		std::size_t evicted = 0;
+		while( m_head < m_times.size() && ( m_times[ m_head ] + m_time ) < t )
+		{
+			m_head++;
+			evicted++;
+		}
+		m_times.push_back( t );
+		if ( m_head > m_times.size() - m_head )
 		{
-			m_mList.pop_front();
-			m_tList.pop_front();
-		}	
-
-		//copy all elements from queue to vector
-		std::vector< typename EventType::value_type > output;
-		output.reserve( m_mList.size() );
-		output.assign( m_mList.begin(), m_mList.end() );
-		LOG4CPP_TRACE( logger, "items in queue: " << m_mList.size() );
- 		m_outPort.send( Measurement::Measurement< typename std::vector< typename EventType::value_type > >( t, output ) );
+			m_times.erase( m_times.begin(), m_times.begin() + m_head );
+			m_head = 0;
+		}
+
+		// copy-on-write: only copy the window if the last sent list is still referenced
+		if ( m_pList.unique() )
+			m_pList->erase( m_pList->begin(), m_pList->begin() + evicted );
+		else
+		{
+			boost::shared_ptr< ListType > pCopy( new ListType );
+			pCopy->reserve( m_times.size() - m_head );
+			pCopy->assign( m_pList->begin() + evicted, m_pList->end() );
+			m_pList = pCopy;
+		}
+		m_pList->push_back( *m_inPort.get() );
+
+		LOG4CPP_TRACE( logger, "items in queue: " << m_pList->size() );
+ 		m_outPort.send( Measurement::Measurement< ListType >( t, m_pList ) );
 	}
 
 	
@@ -101,16 +130,19 @@ protected:
 	Dataflow::TriggerInPort< EventType > m_inPort;
 	
 	/** Output port of the component. */
-	Dataflow::TriggerOutPort< Measurement::Measurement< typename std::vector< typename EventType::value_type > > > m_outPort;
+	Dataflow::TriggerOutPort< Measurement::Measurement< ListType > > m_outPort;
 	
 	/** max event age to be allowed */
 	double m_time; 
 
-	/** queue containing all measurements */
-	std::deque< typename EventType::value_type > m_mList;
-	
-	/** queue containing all timestamps */
-	std::deque< Measurement::Timestamp > m_tList;
+	/** timestamps of the window starting at m_head, preceded by evicted ones */
+	std::vector< Measurement::Timestamp > m_times;
+
+	/** index of the oldest timestamp in the window */
+	std::size_t m_head;
+
+	/** the window, shared with the last sent measurement */
+	boost::shared_ptr< ListType > m_pList;
 };
 
 
@@ -0,0 +1,346 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup dataflow_components
+ * @file
+ * Windowed statistics component.
+ * This class computes mean and covariance of the measurements in a sliding window,
+ * updating running sums instead of aggregating lists.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <utDataflow/TriggerComponent.h>
+#include <utDataflow/TriggerInPort.h>
+#include <utDataflow/TriggerOutPort.h>
+#include <utDataflow/Component.h>
+#include <utDataflow/ComponentFactory.h>
+#include <utMeasurement/Measurement.h>
+#include <utUtil/Exception.h>
+
+#include "RunningStatistics.h"
+#include "FixedQuaternion.h"
+
+
+static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Components.WindowedStatistics" ) );
+
+namespace Ubitrack { namespace Components {
+
+/** conversion of measurements to sample vectors and of statistics to results */
+template< class EventType, class ResultType >
+struct WindowedStatisticsTraits;
+
+/** flips the sign of a quaternion stored at x[ offset ] if it points away from the reference */
+inline void alignQuaternion( double* x, const double* ref, std::size_t offset )
+{
+	double dot = 0.0;
+	for ( std::size_t i = offset; i < offset + 4; i++ )
+		dot += x[ i ] * ref[ i ];
+	if ( dot < 0 )
+		for ( std::size_t i = offset; i < offset + 4; i++ )
+			x[ i ] = -x[ i ];
+}
+
+/**
+ * mean rotation of the quaternions stored at offset, see quaternionScatterMean. Like in CovarianceEstimation,
+ * this is the eigenvector of the scatter matrix, not the normalized arithmetic mean.
+ * @param covariance set to the covariance of the quaternions around the result
+ */
+template< std::size_t N >
+inline Math::Quaternion quaternionMean( const RunningStatistics< N >& stats, std::size_t offset, double covariance[ 4 ][ 4 ] )
+{
+	for ( std::size_t i = 0; i < 4; i++ )
+		for ( std::size_t j = 0; j < 4; j++ )
+			covariance[ i ][ j ] = stats.covariance( offset + i, offset + j );
+	double q[ 4 ];
+	quaternionScatterMean( stats.mean() + offset, covariance, q );
+	return Math::Quaternion( q[ 0 ], q[ 1 ], q[ 2 ], q[ 3 ] );
+}
+
+template<>
+struct WindowedStatisticsTraits< Measurement::Position, Measurement::ErrorPosition >
+{
+	static const std::size_t size = 3;
+
+	static void toVector( const Math::Vector< double, 3 >& p, const RunningStatistics< 3 >&, double* x )
+	{
+		for ( std::size_t i = 0; i < 3; i++ )
+			x[ i ] = p( i );
+	}
+
+	static Math::ErrorVector< double, 3 > result( const RunningStatistics< 3 >& stats )
+	{
+		Math::Vector< double, 3 > mean;
+		Math::Matrix< double, 3, 3 > covariance;
+		for ( std::size_t i = 0; i < 3; i++ )
+		{
+			mean( i ) = stats.mean()[ i ];
+			for ( std::size_t j = 0; j < 3; j++ )
+				covariance( i, j ) = stats.covariance( i, j );
+		}
+		return Math::ErrorVector< double, 3 >( mean, covariance );
+	}
+};
+
+template<>
+struct WindowedStatisticsTraits< Measurement::Pose, Measurement::ErrorPose >
+{
+	static const std::size_t size = 7;
+
+	/** the order is tx, ty, tz, qx, qy, qz, qw */
+	static void toVector( const Math::Pose& p, const RunningStatistics< 7 >& stats, double* x )
+	{
+		for ( std::size_t i = 0; i < 3; i++ )
+			x[ i ] = p.translation()( i );
+		x[ 3 ] = p.rotation().x();
+		x[ 4 ] = p.rotation().y();
+		x[ 5 ] = p.rotation().z();
+		x[ 6 ] = p.rotation().w();
+
+		// take care of quaternion ambiguity
+		if ( stats.count() )
+			alignQuaternion( x, stats.mean(), 3 );
+	}
+
+	/** see CovarianceEstimation for the conversion of the additive 7x7 covariance to the 6x6 format */
+	static Math::ErrorPose result( const RunningStatistics< 7 >& stats )
+	{
+		Math::Vector< double, 3 > pos;
+		for ( std::size_t i = 0; i < 3; i++ )
+			pos( i ) = stats.mean()[ i ];
+		double quaternionCov[ 4 ][ 4 ];
+		Math::Pose mean( quaternionMean( stats, 3, quaternionCov ), pos );
+
+		Math::Vector< double, 7 > invMean;
+		( ~mean ).toVector( invMean );
+		Math::Matrix< double, 7, 7 > covariance;
+		for ( std::size_t i = 0; i < 7; i++ )
+			for ( std::size_t j = 0; j < 7; j++ )
+				covariance( i, j ) = i >= 3 && j >= 3 ? quaternionCov[ i - 3 ][ j - 3 ] : stats.covariance( i, j );
+
+		Math::ErrorPose invEp = Math::ErrorPose::fromAdditiveErrorVector( Math::ErrorVector< double, 7 >( invMean, covariance ) );
+		return Math::ErrorPose( mean, invEp.covariance() );
+	}
+};
+
+template<>
+struct WindowedStatisticsTraits< Measurement::Rotation, Measurement::Rotation >
+{
+	static const std::size_t size = 4;
+
+	static void toVector( const Math::Quaternion& q, const RunningStatistics< 4 >& stats, double* x )
+	{
+		x[ 0 ] = q.x();
+		x[ 1 ] = q.y();
+		x[ 2 ] = q.z();
+		x[ 3 ] = q.w();
+
+		if ( stats.count() )
+			alignQuaternion( x, stats.mean(), 0 );
+	}
+
+	static Math::Quaternion result( const RunningStatistics< 4 >& stats )
+	{
+		double covariance[ 4 ][ 4 ];
+		return quaternionMean( stats, 0, covariance );
+	}
+};
+
+template<>
+struct WindowedStatisticsTraits< Measurement::Distance, Measurement::Distance >
+{
+	static const std::size_t size = 1;
+
+	static void toVector( const Math::Scalar< double >& d, const RunningStatistics< 1 >&, double* x )
+	{
+		x[ 0 ] = double( d );
+	}
+
+	static Math::Scalar< double > result( const RunningStatistics< 1 >& stats )
+	{
+		return Math::Scalar< double >( stats.mean()[ 0 ] );
+	}
+};
+
+
+/**
+ * @ingroup dataflow_components
+ * Mean and covariance over a sliding window.
+ *
+ * @par Input Ports
+ * TriggerInPort< EventType > with name "Input".
+ *
+ * @par Output Ports
+ * TriggerOutPort< ResultType > with name "Output".
+ *
+ * @par Configuration
+ * \c time: maximum age of the measurements in the window in ms
+ * \c size: maximum number of measurements in the window
+ * At least one of them must be given.
+ *
+ * @par Operation
+ * Each input is added to running sums and the measurements that leave the window are removed,
+ * so the cost per event does not depend on the window length. After as many removals as the window
+ * holds, the sums are recomputed from the window to stop rounding errors from accumulating.
+ * Positions and poses are sent with their covariance, rotations and distances as mean only.
+ * The mean rotation is computed from the quaternion scatter matrix like in CovarianceEstimation.
+ *
+ * @par Instances
+ * Registered for Position (ErrorPosition result), Pose (ErrorPose result), Rotation and Distance.
+ */
+template< class EventType, class ResultType >
+class WindowedStatistics
+	: public Dataflow::TriggerComponent
+{
+public:
+	typedef WindowedStatisticsTraits< EventType, ResultType > Traits;
+	static const std::size_t N = Traits::size;
+
+	/**
+	 * UTQL component constructor.
+	 *
+	 * @param sName Unique name of the component.
+	 * @param subgraph UTQL subgraph
+	 */
+	WindowedStatistics( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > cfg )
+		: Dataflow::TriggerComponent( sName, cfg )
+		, m_inPort( "Input", *this )
+		, m_outPort( "Output", *this )
+		, m_time( 0.0 )
+		, m_size( 0 )
+		, m_head( 0 )
+		, m_count( 0 )
+		, m_removals( 0 )
+	{
+		if ( cfg->m_DataflowAttributes.hasAttribute( "time" ) )
+		{
+			cfg->m_DataflowAttributes.getAttributeData( "time", m_time );
+			m_time *= 1e+06; //ms to ns
+		}
+		cfg->m_DataflowAttributes.getAttributeData( "size", m_size );
+
+		if ( m_time <= 0 && m_size == 0 )
+			UBITRACK_THROW( "WindowedStatistics requires a time or size attribute" );
+	}
+
+	/** Method that computes the result. */
+	void compute( Measurement::Timestamp t )
+	{
+		// add the newest sample
+		if ( m_count == m_times.size() )
+			grow();
+		std::size_t tail = ( m_head + m_count ) % m_times.size();
+		Traits::toVector( *m_inPort.get(), m_stats, &m_samples[ tail * N ] );
+		m_times[ tail ] = t;
+		m_count++;
+		m_stats.add( &m_samples[ tail * N ] );
+
+		// remove samples that left the window
+		while ( ( m_size && m_count > m_size ) || ( m_time > 0 && m_times[ m_head ] + m_time < t ) )
+		{
+			m_stats.remove( &m_samples[ m_head * N ] );
+			m_head = ( m_head + 1 ) % m_times.size();
+			m_count--;
+			m_removals++;
+		}
+
+		if ( m_removals >= std::max< std::size_t >( m_count, 64 ) )
+			recompute();
+
+		LOG4CPP_TRACE( logger, "samples in window: " << m_count );
+		m_outPort.send( ResultType( t, Traits::result( m_stats ) ) );
+	}
+
+protected:
+	/** recomputes the running statistics from the window */
+	void recompute()
+	{
+		m_stats.reset();
+		for ( std::size_t i = 0; i < m_count; i++ )
+			m_stats.add( &m_samples[ ( ( m_head + i ) % m_times.size() ) * N ] );
+		m_removals = 0;
+	}
+
+	/** doubles the ring capacity, moving the samples to the front */
+	void grow()
+	{
+		std::size_t capacity = std::max< std::size_t >( 16, 2 * m_times.size() );
+		if ( m_size )
+			capacity = std::min( capacity, m_size + 1 );
+
+		std::vector< double > samples( capacity * N );
+		std::vector< Measurement::Timestamp > times( capacity );
+		for ( std::size_t i = 0; i < m_count; i++ )
+		{
+			std::size_t j = ( m_head + i ) % m_times.size();
+			std::copy( m_samples.begin() + j * N, m_samples.begin() + ( j + 1 ) * N, samples.begin() + i * N );
+			times[ i ] = m_times[ j ];
+		}
+		m_samples.swap( samples );
+		m_times.swap( times );
+		m_head = 0;
+	}
+
+	/** Input port of the component. */
+	Dataflow::TriggerInPort< EventType > m_inPort;
+
+	/** Output port of the component. */
+	Dataflow::TriggerOutPort< ResultType > m_outPort;
+
+	/** max event age in ns, 0 if unlimited */
+	double m_time;
+
+	/** max number of events, 0 if unlimited */
+	std::size_t m_size;
+
+	/** ring of sample vectors, N values per sample */
+	std::vector< double > m_samples;
+
+	/** ring of timestamps */
+	std::vector< Measurement::Timestamp > m_times;
+
+	/** index of the oldest sample */
+	std::size_t m_head;
+
+	/** number of samples in the window */
+	std::size_t m_count;
+
+	/** number of removals since the last recomputation */
+	std::size_t m_removals;
+
+	/** running mean and covariance of the window */
+	RunningStatistics< N > m_stats;
+};
+
+
+UBITRACK_REGISTER_COMPONENT( Dataflow::ComponentFactory* const cf )
+{
+	cf->registerComponent< WindowedStatistics< Measurement::Position, Measurement::ErrorPosition > > ( "PositionWindowedStatistics" );
+	cf->registerComponent< WindowedStatistics< Measurement::Pose, Measurement::ErrorPose > > ( "PoseWindowedStatistics" );
+	cf->registerComponent< WindowedStatistics< Measurement::Rotation, Measurement::Rotation > > ( "RotationWindowedStatistics" );
+	cf->registerComponent< WindowedStatistics< Measurement::Distance, Measurement::Distance > > ( "DistanceWindowedStatistics" );
+}
+
+} } // namespace Ubitrack::Components
@@ -37,8 +37,6 @@
 
 // Boost
 #include <boost/bind.hpp>
-#include <boost/thread.hpp>
-#include <boost/scoped_ptr.hpp>
 
 // Ubitrack
 #include <utUtil/OS.h>
@@ -47,6 +45,7 @@
 #include <utDataflow/Component.h>
 #include <utDataflow/PushSupplier.h>
 #include <utDataflow/ComponentFactory.h>
+#include <utComponents/TimerService.h>
 
 
 namespace Ubitrack { namespace Drivers {
@@ -59,11 +58,8 @@ protected:
 	/** Output ports of the component. */
 	Dataflow::PushSupplier< Measurement::Button > m_outPort;
 	
-	/** signs if the component should be stoppped. */
-	bool m_bStop;
-	
-	/** thread that checks for keyboard input. */
-	boost::scoped_ptr< boost::thread > m_pThread;
+	/** registration with the timer service that polls for keyboard input. */
+	Components::TimerService::Handle m_timerHandle;
 	
 public:
 	/**
@@ -75,6 +71,7 @@ public:
 	KeyboardEvent( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > pCfg )
 		: Dataflow::Component( sName )
 		, m_outPort( "Output" , *this )
+		, m_timerHandle( 0 )
     {
 	}
 	
@@ -84,44 +81,43 @@ public:
 		stop();
 	}
 	
-	/** component start method, starts thread */
+	/** component start method, starts polling */
 	virtual void start()
 	{
 		if ( !m_running )
 		{
-			m_bStop = false;
 			m_running = true;
-			m_pThread.reset( new boost::thread( boost::bind( &KeyboardEvent::mainLoop, this ) ) );
+			///@todo make an unix alternative, since this is Windows only at the moment
+#ifdef WIN32
+			m_timerHandle = Components::TimerService::singleton().add( 500.0, boost::bind( &KeyboardEvent::poll, this, _1 ) );
+#endif
 		}
 	}
 
-	/** component stop method, stops thread */
+	/** component stop method, stops polling */
 	virtual void stop()
 	{
 		if ( m_running )
 		{
-			m_bStop = true;
 			m_running = false;
-			if ( m_pThread )
-				m_pThread->join();
+			if ( m_timerHandle )
+			{
+				Components::TimerService::singleton().remove( m_timerHandle );
+				m_timerHandle = 0;
+			}
 		}
 	}
 	
-	void mainLoop()
+	/** checks for keyboard input, called periodically by the timer service */
+	void poll( Measurement::Timestamp t )
 	{
-		while( !m_bStop )
-		{
-			Util::sleep( 2 );
-			///@todo make an unix alternative, since this is Windows only at the moment
 #ifdef WIN32
-			if(kbhit())
-			{
-				int c = getch();
-				Measurement::Timestamp t = Measurement::now();
-				m_outPort.send( Measurement::Button( t, Math::Scalar< int >( c ) ) );
-			}
-#endif
+		if(kbhit())
+		{
+			int c = getch();
+			m_outPort.send( Measurement::Button( t, Math::Scalar< int >( c ) ) );
 		}
+#endif
 	}
 
 };
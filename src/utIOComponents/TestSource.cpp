@@ -31,15 +31,15 @@
 
 #include <string>
 
-#include <boost/scoped_ptr.hpp>
 #include <boost/bind.hpp>
-#include <boost/thread.hpp>
 
 #include <utDataflow/PushSupplier.h>
 #include <utDataflow/Component.h>
 #include <utDataflow/ComponentFactory.h>
 #include <utMeasurement/Measurement.h>
 #include <utUtil/OS.h>
+#include <utComponents/TimerService.h>
+#include <utComponents/CounterRandom.h>
 
 #include <log4cpp/Category.hh>
 
@@ -51,25 +51,33 @@ using namespace Ubitrack;
 // TODO: Move random data generation to ubitracklib. Tests need it, too
 namespace {
 
+using Ubitrack::Components::CounterRandom;
+
 // returns a random number between -1 and +1
-double random()
+double random( CounterRandom& rng )
 {
-	return double( rand() ) / RAND_MAX * 2.0 - 1.0;
+	return rng.uniform01() * 2.0 - 1.0;
 }
 
-Math::Vector< double, 3 > randomPosition( const Math::Vector< double, 3 >& ref, double noise )
+Math::Vector< double, 3 > randomPosition( CounterRandom& rng, const Math::Vector< double, 3 >& ref, double noise )
 {
-	return ref + Math::Vector< double, 3 >( random() * noise, random() * noise, random() * noise );
+	double x = random( rng ) * noise;
+	double y = random( rng ) * noise;
+	double z = random( rng ) * noise;
+	return ref + Math::Vector< double, 3 >( x, y, z );
 }
 
-Math::Quaternion randomRotation( const Math::Quaternion& ref, double noise )
+Math::Quaternion randomRotation( CounterRandom& rng, const Math::Quaternion& ref, double noise )
 {
-	Math::Quaternion qRand( random() * noise, random() * noise, random() * noise, 0 );
+	double x = random( rng ) * noise;
+	double y = random( rng ) * noise;
+	double z = random( rng ) * noise;
+	Math::Quaternion qRand( x, y, z, 0 );
 	double qNorm = boost::math::norm( qRand );
 	if ( qNorm > 1.0 )
 	{
 		// too large
-		double newNorm = ( random() + 1.0 ) / 2.0;
+		double newNorm = ( random( rng ) + 1.0 ) / 2.0;
 		qRand *= newNorm / qNorm;
 		qNorm = newNorm;
 	}
@@ -104,13 +112,19 @@ namespace Ubitrack { namespace Components {
  *   - \c frequency : float describing number of events to generate per second (defaults to "30")
  *   - \c posnoise : float giving the max radius around \c position in which to move (defaults to "0")
  *   - \c rotnoise : float giving the max sine of the angle around \c rotation by which to rotate (defaults to "0")
+ *   - \c seed : seed of the random numbers, seeded from the clock if not given
+ *   - \c stream : random stream id, derived from the component name if not given
  *   .
  * Depending on the instantiated type of the component
  * either the position, the rotation or both parts
  * are mandatory.
  *
  * @par Operation
- * Creates an event \c frequency times per second with optional noise
+ * Creates an event \c frequency times per second with optional noise.
+ * The events are generated from the shared TimerService thread.
+ * The noise is drawn from a counter-based random number generator, so the same
+ * seed and stream always produce the same sequence of events. Like in the Perturbation
+ * components, any given seed including 0 is used as is.
  *
  * @par Instances
  * Registered for the following EventTypes and names:
@@ -132,7 +146,7 @@ public:
 	TestSource( const std::string& sName, boost::shared_ptr< Graph::UTQLSubgraph > subgraph )
 		: Dataflow::Component( sName )
 		, m_outPort( "Output", *this )
-		, m_bStop( true )
+		, m_timerHandle( 0 )
 		, m_frequency( 30.0 )
 		, m_jerkTime( 3000 )
 		, m_posNoise( 0.1 )
@@ -145,40 +159,54 @@ public:
 		subgraph->m_DataflowAttributes.getAttributeData( "rotnoise", m_rotNoise );
 		subgraph->m_DataflowAttributes.getAttributeData( "frequency", m_frequency );
 		subgraph->m_DataflowAttributes.getAttributeData( "jerktime", m_jerkTime );
+
+		unsigned long long seed( Measurement::now() );
+		unsigned long long stream( CounterRandom::streamFromName( sName ) );
+		if ( subgraph->m_DataflowAttributes.hasAttribute( "seed" ) )
+			subgraph->m_DataflowAttributes.getAttributeData( "seed", seed );
+		if ( subgraph->m_DataflowAttributes.hasAttribute( "stream" ) )
+			subgraph->m_DataflowAttributes.getAttributeData( "stream", stream );
+		m_rng.seed( seed, stream );
 		
 
-		// start thread
 		LOG4CPP_INFO( logger, "starting TestSource with frequency " << m_frequency );
 		LOG4CPP_DEBUG( logger, "noise: " << m_posNoise << " " << m_rotNoise );
 		stop();
 	}
 
-	/** component start method, starts thread */
+	/** component start method, registers with the timer service */
 	virtual void start()
 	{
 		if ( !m_running )
 		{
-			m_bStop = false;
 			m_running = true;
 			if ( m_frequency )
-				m_pThread.reset( new boost::thread( boost::bind( &TestSource< EventType >::mainLoop, this ) ) );
+			{
+				m_prevMeasurement = randomEvent( m_rng, m_staticMeasurement, m_posNoise, m_rotNoise );
+				m_nextMeasurement = randomEvent( m_rng, m_staticMeasurement, m_posNoise, m_rotNoise );
+				m_lastTime = Measurement::now();
+				m_timerHandle = TimerService::singleton().add( m_frequency,
+					boost::bind( &TestSource< EventType >::tick, this, _1 ) );
+			}
 		}
 	}
 
-	/** component stop method, stops thread */
+	/** component stop method, removes the timer */
 	virtual void stop()
 	{
 		if ( m_running )
 		{
 			LOG4CPP_INFO( logger, "stopping TestSource" );
-			m_bStop = true;
 			m_running = false;
-			if ( m_pThread )
-				m_pThread->join();
+			if ( m_timerHandle )
+			{
+				TimerService::singleton().remove( m_timerHandle );
+				m_timerHandle = 0;
+			}
 		}
 	}
 
-	/** destructor, stops thread */
+	/** destructor, stops timer */
 	~TestSource()
 	{
 		stop();
@@ -192,38 +220,27 @@ protected:
 	void readStatic( const Graph::UTQLSubgraph& subgraph );
 
 	/**
-	 * The main loop, running in a separate thread
+	 * Generates one event, called periodically by the timer service
 	 */
-	void mainLoop()
+	void tick( Measurement::Timestamp now )
 	{
-		// initialize
 		Measurement::Timestamp jerkInterval = Measurement::Timestamp( 1000000 ) * m_jerkTime;
-		m_prevMeasurement = randomEvent( m_staticMeasurement, m_posNoise, m_rotNoise );
-		m_nextMeasurement = randomEvent( m_staticMeasurement, m_posNoise, m_rotNoise );
 
-		Measurement::Timestamp lastTime = Measurement::now();
-		while ( !m_bStop )
+		// compute new random position?
+		if ( now / jerkInterval > m_lastTime / jerkInterval )
 		{
-			// sleep some time
-			Util::sleep( unsigned( 1000.0 / m_frequency ) );
-
-			// compute new random position?
-			Measurement::Timestamp now = Measurement::now();
-			if ( now / jerkInterval > lastTime / jerkInterval )
-			{
-				m_prevMeasurement = m_nextMeasurement;
-				m_nextMeasurement = randomEvent( m_staticMeasurement, m_posNoise, m_rotNoise );
-			}
+			m_prevMeasurement = m_nextMeasurement;
+			m_nextMeasurement = randomEvent( m_rng, m_staticMeasurement, m_posNoise, m_rotNoise );
+		}
 
-			// interpolate
-			EventType event( now,
-				linearInterpolate( m_prevMeasurement, m_nextMeasurement, double( now % jerkInterval ) / jerkInterval ) );
+		// interpolate
+		EventType event( now,
+			linearInterpolate( m_prevMeasurement, m_nextMeasurement, double( now % jerkInterval ) / jerkInterval ) );
 
-			// send
-			m_outPort.send( event );
+		// send
+		m_outPort.send( event );
 
-			lastTime = now;
-		}
+		m_lastTime = now;
 	}
 
 	/// helper function to check and parse position attribute
@@ -243,16 +260,16 @@ protected:
 	}
 
 	// creates a random event
-	static typename EventType::value_type randomEvent( const typename EventType::value_type& ref, double posNoise, double rotNoise );
+	static typename EventType::value_type randomEvent( CounterRandom& rng, const typename EventType::value_type& ref, double posNoise, double rotNoise );
 
 	// the output port
 	Dataflow::PushSupplier< EventType > m_outPort;
 
-	// pointer to thread
-	boost::scoped_ptr< boost::thread > m_pThread;
+	// registration with the timer service
+	TimerService::Handle m_timerHandle;
 
-	// should the thread stop?
-	bool m_bStop;
+	// time of the last event
+	Measurement::Timestamp m_lastTime;
 
 	// event generation frequency
 	double m_frequency;
@@ -264,6 +281,9 @@ protected:
 	double m_posNoise;
 	double m_rotNoise;
 
+	// random numbers for the noise
+	CounterRandom m_rng;
+
 	// the static measurement as specified in the configuration
 	typename EventType::value_type m_staticMeasurement;
 
@@ -315,25 +335,26 @@ void TestSource< Measurement::Pose >::readStatic( const Graph::UTQLSubgraph& sub
 
 template<>
 Math::Vector< double, 3 > TestSource< Measurement::Position >::randomEvent(
-	const Math::Vector< double, 3 >& ref, double posNoise, double )
+	CounterRandom& rng, const Math::Vector< double, 3 >& ref, double posNoise, double )
 {
-	return randomPosition( ref, posNoise );
+	return randomPosition( rng, ref, posNoise );
 }
 
 
 template<>
 Math::Quaternion TestSource< Measurement::Rotation >::randomEvent(
-	const Math::Quaternion& ref, double, double rotNoise )
+	CounterRandom& rng, const Math::Quaternion& ref, double, double rotNoise )
 {
-	return randomRotation( ref, rotNoise );
+	return randomRotation( rng, ref, rotNoise );
 }
 
 
 template<>
 Math::Pose TestSource< Measurement::Pose >::randomEvent(
-	const Math::Pose& ref, double posNoise, double rotNoise )
+	CounterRandom& rng, const Math::Pose& ref, double posNoise, double rotNoise )
 {
-	return Math::Pose( randomRotation( ref.rotation(), rotNoise ), randomPosition( ref.translation(), posNoise ) );
+	Math::Quaternion rot( randomRotation( rng, ref.rotation(), rotNoise ) );
+	return Math::Pose( rot, randomPosition( rng, ref.translation(), posNoise ) );
 }
 
 